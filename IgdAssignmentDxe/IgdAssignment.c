@@ -13,19 +13,75 @@
   WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 **/
 
+#include <PiDxe.h>
+
 #include <IndustryStandard/Pci22.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/PrintLib.h>
 #include <Library/QemuFwCfgLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/IgdContext.h>
 #include <Protocol/PciIo.h>
+#include <Protocol/PciRootBridgeIo.h>
+#include <Protocol/S3SaveState.h>
 
 #include <IndustryStandard/AssignedIgd.h>
 #include <IndustryStandard/IgdOpRegion.h>
 
+#include "IgdClearMem.h"
+#include "IgdFwCfg.h"
+#include "IgdNuma.h"
 #include "IgdPrivate.h"
 
+//
+// reservations made for a device, keyed by its PCI location, so that a device
+// showing up again under a new PciIo instance (after BDS reconnects
+// controllers, or the PCI bus is re-enumerated) reuses them
+//
+typedef struct {
+  UINTN                Segment;
+  UINTN                Bus;
+  UINTN                Device;
+  UINTN                Function;
+  UINT32               Flags;
+  EFI_PHYSICAL_ADDRESS OpRegion;
+  UINTN                OpRegionPages;
+  EFI_PHYSICAL_ADDRESS Bdsm;
+  UINTN                BdsmPages;
+  //
+  // whether setup has succeeded; if not, the parts that are missing are set up
+  // again when the device shows up next
+  //
+  BOOLEAN              Complete;
+  //
+  // IGD_CONTEXT_PROTOCOL instance of the device, and the handle it was last
+  // installed on
+  //
+  IGD_CONTEXT_PROTOCOL Context;
+  EFI_HANDLE           ContextHandle;
+} IGD_DEVICE_RECORD;
+
+#define MAX_IGD_DEVICES 16
+
+//
+// Stolen memory is only rounded up to an alignment in mBdsmAlignments if that
+// wastes no more than 1/2^BDSM_ALIGN_WASTE_SHIFT of its size.
+//
+#define BDSM_ALIGN_WASTE_SHIFT 3
+
+//
+// Number of times to retry an allocation whose free range has been taken by a
+// concurrent allocation between scanning the memory map and claiming it.
+//
+#define ALLOCATE_ALIGNED_RETRIES 4
+
+//
+// Largest OpRegion size accepted from the ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS
+// header; an OpRegion with an extended VBT is well below it.
+//
+#define OPREGION_EXTENTS_SIZE_MAX SIZE_64KB
+
 //
 // structure that collects information from PCI config space that is needed to
 // evaluate whether IGD assignment applies to the device
@@ -40,33 +96,98 @@ typedef struct {
   UINTN  Function;
   CHAR8  Name[sizeof "0000:00:02.0"];
   CONST IGD_PRIVATE_DATA *Private;
+  IGD_DEVICE_RECORD      *Record;
 } CANDIDATE_PCI_INFO;
 
 //
-// selector and size of ASSIGNED_IGD_FW_CFG_OPREGION
+// fw_cfg file to download OpRegion contents from
+//
+typedef struct {
+  FIRMWARE_CONFIG_ITEM Item;
+  UINTN                ItemSize;
+  //
+  // size of the OpRegion; equal to ItemSize unless Extents is set
+  //
+  UINTN                Size;
+  //
+  // whether the file is in the ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS format
+  //
+  BOOLEAN              Extents;
+} OPREGION_SOURCE;
+
+//
+// ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS or ASSIGNED_IGD_FW_CFG_OPREGION; Size
+// is zero if there is neither
+//
+STATIC OPREGION_SOURCE      mOpRegion;
+//
+// OpRegion mapped by the host, see ASSIGNED_IGD_FW_CFG_OPREGION_RANGE; Size is
+// zero if there is none
+//
+STATIC ASSIGNED_IGD_FW_CFG_RANGE mOpRegionRange;
+//
+// value read from ASSIGNED_IGD_FW_CFG_BDSM_SIZE
+//
+STATIC UINT64               mBdsmSize;
+//
+// whether stolen memory must be zeroed, see ASSIGNED_IGD_FW_CFG_BDSM_CLEAR
+//
+STATIC BOOLEAN              mBdsmClear = TRUE;
+//
+// whether 64-bit BDSM may be placed above 4GB, see
+// ASSIGNED_IGD_FW_CFG_BDSM_ABOVE_4G
+//
+STATIC BOOLEAN              mBdsmAbove4G = FALSE;
+//
+// stolen memory range designated by the host, see
+// ASSIGNED_IGD_FW_CFG_BDSM_RANGE; Size is zero if there is none
+//
+STATIC ASSIGNED_IGD_FW_CFG_RANGE mBdsmRange;
+//
+// private data of the IGD at the fixed location, as described by the host in
+// ASSIGNED_IGD_FW_CFG_DEVICE_INFO; used in place of GetIgdPrivateData() if
+// mHostPrivateValid is set
 //
-STATIC FIRMWARE_CONFIG_ITEM mOpRegionItem;
-STATIC UINTN                mOpRegionSize;
+STATIC IGD_PRIVATE_DATA     mHostPrivate;
+STATIC BOOLEAN              mHostPrivateValid;
+//
+// number of per-device files under ASSIGNED_IGD_FW_CFG_OPREGION_DIR and
+// ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR
+//
+STATIC UINTN                mDeviceFileCount;
 
 //
-// gBS->LocateProtocol() helper for finding the next unhandled PciIo instance
+// devices that have been set up
+//
+STATIC IGD_DEVICE_RECORD    mDevices[MAX_IGD_DEVICES];
+STATIC UINTN                mDeviceCount;
+
+//
+// gBS->LocateHandle() helper for finding the next unhandled PciIo instance
 //
 STATIC VOID                 *mPciIoTracker;
 
+//
+// PciIo installation callback, closed once the IGD at the fixed location has
+// been set up completely
+//
+STATIC EFI_EVENT            mPciIoEvent;
+
 
 /**
-  Populate the CANDIDATE_PCI_INFO structure for a PciIo protocol instance.
+  Populate the location fields of the CANDIDATE_PCI_INFO structure for a PciIo
+  protocol instance. This involves no PCI config space access.
 
   @param[in] PciIo     EFI_PCI_IO_PROTOCOL instance to interrogate.
 
   @param[out] PciInfo  CANDIDATE_PCI_INFO structure to fill.
 
-  @retval EFI_SUCCESS  PciInfo has been filled in. PciInfo->Name has been set
-                       to the empty string.
+  @retval EFI_SUCCESS  The location in PciInfo has been filled in.
+                       PciInfo->Name has been set to the empty string,
+                       PciInfo->Private and PciInfo->Record to NULL.
 
-  @return              Error codes from PciIo->Pci.Read() and
-                       PciIo->GetLocation(). The contents of PciInfo are
-                       indeterminate.
+  @return              Error codes from PciIo->GetLocation(). The contents of
+                       PciInfo are indeterminate.
 **/
 STATIC
 EFI_STATUS
@@ -77,51 +198,86 @@ InitPciInfo (
 {
   EFI_STATUS Status;
 
-  Status = PciIo->Pci.Read (
-                        PciIo,
-                        EfiPciIoWidthUint16,
-                        PCI_VENDOR_ID_OFFSET,
-                        1,                    // Count
-                        &PciInfo->VendorId
-                        );
+  Status = PciIo->GetLocation (
+                    PciIo,
+                    &PciInfo->Segment,
+                    &PciInfo->Bus,
+                    &PciInfo->Device,
+                    &PciInfo->Function
+                    );
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  PciInfo->Name[0] = '\0';
+  PciInfo->Private = NULL;
+  PciInfo->Record  = NULL;
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Populate the identification fields of the CANDIDATE_PCI_INFO structure for a
+  PciIo protocol instance. Each config space access traps to the host, so
+  registers are read a dword at a time, and non-Intel devices are rejected
+  after the first access.
+
+  @param[in] PciIo     EFI_PCI_IO_PROTOCOL instance to interrogate.
+
+  @param[out] PciInfo  CANDIDATE_PCI_INFO structure to fill.
+
+  @retval EFI_SUCCESS      The identification fields of PciInfo have been
+                           filled in.
+
+  @retval EFI_UNSUPPORTED  The device is not an Intel device. Only VendorId and
+                           DeviceId have been filled in.
+
+  @return                  Error codes from PciIo->Pci.Read(). The contents of
+                           the identification fields are indeterminate.
+**/
+STATIC
+EFI_STATUS
+ReadPciIds (
+  IN     EFI_PCI_IO_PROTOCOL *PciIo,
+  IN OUT CANDIDATE_PCI_INFO  *PciInfo
+  )
+{
+  EFI_STATUS Status;
+  UINT32     Dword;
+
   Status = PciIo->Pci.Read (
                         PciIo,
-                        EfiPciIoWidthUint16,
-                        PCI_DEVICE_ID_OFFSET,
+                        EfiPciIoWidthUint32,
+                        PCI_VENDOR_ID_OFFSET,
                         1,                    // Count
-                        &PciInfo->DeviceId
+                        &Dword
                         );
   if (EFI_ERROR (Status)) {
     return Status;
   }
+  PciInfo->VendorId = (UINT16)Dword;
+  PciInfo->DeviceId = (UINT16)(Dword >> 16);
+  if (PciInfo->VendorId != ASSIGNED_IGD_PCI_VENDOR_ID) {
+    return EFI_UNSUPPORTED;
+  }
 
+  //
+  // The class code occupies the upper three bytes of the dword that starts
+  // with the revision ID.
+  //
   Status = PciIo->Pci.Read (
                         PciIo,
-                        EfiPciIoWidthUint8,
-                        PCI_CLASSCODE_OFFSET,
-                        sizeof PciInfo->ClassCode,
-                        PciInfo->ClassCode
+                        EfiPciIoWidthUint32,
+                        PCI_REVISION_ID_OFFSET,
+                        1,                    // Count
+                        &Dword
                         );
   if (EFI_ERROR (Status)) {
     return Status;
   }
-
-  Status = PciIo->GetLocation (
-                    PciIo,
-                    &PciInfo->Segment,
-                    &PciInfo->Bus,
-                    &PciInfo->Device,
-                    &PciInfo->Function
-                    );
-  if (EFI_ERROR (Status)) {
-    return Status;
-  }
-
-  PciInfo->Name[0] = '\0';
+  PciInfo->ClassCode[0] = (UINT8)(Dword >> 8);
+  PciInfo->ClassCode[1] = (UINT8)(Dword >> 16);
+  PciInfo->ClassCode[2] = (UINT8)(Dword >> 24);
   return EFI_SUCCESS;
 }
 
@@ -155,13 +311,582 @@ GetPciName (
   return PciInfo->Name;
 }
 
+
+/**
+  Determine whether a device is at the fixed IGD location, 0000:00:02.0.
+
+  @param[in] PciInfo  CANDIDATE_PCI_INFO of the device, with its location
+                      fields filled in.
+
+  @retval TRUE   The device is at the fixed location.
+
+  @retval FALSE  The device is elsewhere.
+**/
+STATIC
+BOOLEAN
+IsFixedIgdLocation (
+  IN CONST CANDIDATE_PCI_INFO *PciInfo
+  )
+{
+  return (BOOLEAN)(PciInfo->Segment == ASSIGNED_IGD_PCI_SEGMENT &&
+                   PciInfo->Bus == ASSIGNED_IGD_PCI_BUS &&
+                   PciInfo->Device == ASSIGNED_IGD_PCI_DEVICE &&
+                   PciInfo->Function == ASSIGNED_IGD_PCI_FUNCTION);
+}
+
+
+/**
+  Look up the per-device fw_cfg file of a device.
+
+  @param[in] Prefix       ASSIGNED_IGD_FW_CFG_OPREGION_DIR or
+                          ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR.
+
+  @param[in,out] PciInfo  The device to look up the file for. GetPciName() is
+                          called on PciInfo, possibly modifying it.
+
+  @param[out] Item        The fw_cfg selector of the file.
+
+  @param[out] Size        The size of the file.
+
+  @retval EFI_SUCCESS     The file has been found.
+
+  @retval EFI_NOT_FOUND   There are no per-device files, or none for the
+                          device.
+**/
+STATIC
+EFI_STATUS
+FindDeviceFile (
+  IN     CONST CHAR8          *Prefix,
+  IN OUT CANDIDATE_PCI_INFO   *PciInfo,
+  OUT    FIRMWARE_CONFIG_ITEM *Item,
+  OUT    UINTN                *Size
+  )
+{
+  CHAR8 Name[QEMU_FW_CFG_FNAME_SIZE];
+
+  if (mDeviceFileCount == 0) {
+    return EFI_NOT_FOUND;
+  }
+  AsciiSPrint (Name, sizeof Name, "%a%a", Prefix, GetPciName (PciInfo));
+  return IgdFwCfgFindFile (Name, Item, Size);
+}
+
+
+/**
+  Read the per-device stolen memory size of a device.
+
+  @param[in,out] PciInfo  The device to read the size for. GetPciName() is
+                          called on PciInfo, possibly modifying it.
+
+  @return  The stolen memory size from the device's
+           ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR file, or zero if there is no such
+           file or it is malformed.
+**/
+STATIC
+UINT64
+GetDeviceBdsmSize (
+  IN OUT CANDIDATE_PCI_INFO *PciInfo
+  )
+{
+  EFI_STATUS           Status;
+  FIRMWARE_CONFIG_ITEM Item;
+  UINTN                ItemSize;
+  UINT64               BdsmSize;
+
+  Status = FindDeviceFile (ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR, PciInfo, &Item,
+             &ItemSize);
+  if (EFI_ERROR (Status)) {
+    return 0;
+  }
+  if (ItemSize != sizeof BdsmSize) {
+    DEBUG ((DEBUG_ERROR, "%a: %a: invalid fw_cfg size: %Lu\n", __FUNCTION__,
+      GetPciName (PciInfo), (UINT64)ItemSize));
+    return 0;
+  }
+  QemuFwCfgSelectItem (Item);
+  QemuFwCfgReadBytes (ItemSize, &BdsmSize);
+  if (BdsmSize > MAX_UINTN) {
+    DEBUG ((DEBUG_ERROR, "%a: %a: invalid value: 0x%Lx\n", __FUNCTION__,
+      GetPciName (PciInfo), BdsmSize));
+    return 0;
+  }
+  return BdsmSize;
+}
+
+
 /**
-  Allocate memory in the 32-bit address space, with the requested UEFI memory
-  type and the requested alignment.
+  Determine whether a device is an SR-IOV virtual function of the IGD.
+
+  A VF can't be told apart from the physical function by its IDs or class
+  code, but it implements neither the GMCH nor the BDSM register, and it is
+  never placed at the fixed IGD location. A device that the host describes
+  with per-device fw_cfg files is never taken for a VF.
+
+  @param[in] PciIo        EFI_PCI_IO_PROTOCOL instance of the device.
+
+  @param[in,out] PciInfo  CANDIDATE_PCI_INFO of the device, with its location,
+                          identification and Private fields filled in.
+                          GetPciName() may be called on PciInfo, possibly
+                          modifying it.
+
+  @retval TRUE   The device is a VF, and needs neither an OpRegion nor stolen
+                 memory.
+
+  @retval FALSE  The device may be the physical function.
+**/
+STATIC
+BOOLEAN
+IsVirtualFunction (
+  IN     EFI_PCI_IO_PROTOCOL *PciIo,
+  IN OUT CANDIDATE_PCI_INFO  *PciInfo
+  )
+{
+  EFI_STATUS           Status;
+  FIRMWARE_CONFIG_ITEM Item;
+  UINTN                ItemSize;
+  UINT32               Gmch;
+  UINT64               Bdsm;
+
+  if (IsFixedIgdLocation (PciInfo)) {
+    return FALSE;
+  }
+  if (!EFI_ERROR (FindDeviceFile (ASSIGNED_IGD_FW_CFG_OPREGION_DIR, PciInfo,
+                    &Item, &ItemSize)) ||
+      !EFI_ERROR (FindDeviceFile (ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR, PciInfo,
+                    &Item, &ItemSize))) {
+    return FALSE;
+  }
+
+  Status = PciIo->Pci.Read (
+                        PciIo,
+                        EfiPciIoWidthUint32,
+                        ASSIGNED_IGD_PCI_GMCH_OFFSET,
+                        1,                            // Count
+                        &Gmch
+                        );
+  if (EFI_ERROR (Status) || Gmch != 0) {
+    return FALSE;
+  }
+
+  //
+  // Probe the BDSM register that the device generation implements.
+  //
+  Bdsm = 0;
+  if (PciInfo->Private->Flags & IGD_FLAG_BDSM_64BIT) {
+    Status = PciIo->Pci.Read (
+                          PciIo,
+                          EfiPciIoWidthUint64,
+                          ASSIGNED_IGD_PCI_BDSM64_OFFSET,
+                          1,                            // Count
+                          &Bdsm
+                          );
+  } else {
+    Status = PciIo->Pci.Read (
+                          PciIo,
+                          EfiPciIoWidthUint32,
+                          ASSIGNED_IGD_PCI_BDSM_OFFSET,
+                          1,                            // Count
+                          &Bdsm
+                          );
+  }
+  if (EFI_ERROR (Status) || Bdsm != 0) {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/**
+  Look up the IGD_DEVICE_RECORD of a device by PCI location.
+
+  @param[in] PciInfo  The device to look up.
+
+  @return             The record of the device, or NULL if the device has not
+                      been set up before.
+**/
+STATIC
+IGD_DEVICE_RECORD *
+FindDeviceRecord (
+  IN CONST CANDIDATE_PCI_INFO *PciInfo
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < mDeviceCount; Index++) {
+    if (mDevices[Index].Segment == PciInfo->Segment &&
+        mDevices[Index].Bus == PciInfo->Bus &&
+        mDevices[Index].Device == PciInfo->Device &&
+        mDevices[Index].Function == PciInfo->Function) {
+      return &mDevices[Index];
+    }
+  }
+  return NULL;
+}
+
+
+/**
+  Create an empty IGD_DEVICE_RECORD for a device.
+
+  @param[in] PciInfo  The device to create the record for. PciInfo->Private
+                      must have been set.
+
+  @return             The new record, or NULL if there is no room for it.
+**/
+STATIC
+IGD_DEVICE_RECORD *
+AddDeviceRecord (
+  IN CONST CANDIDATE_PCI_INFO *PciInfo
+  )
+{
+  IGD_DEVICE_RECORD *Record;
+
+  if (mDeviceCount == MAX_IGD_DEVICES) {
+    return NULL;
+  }
+  Record = &mDevices[mDeviceCount++];
+  ZeroMem (Record, sizeof *Record);
+  Record->Segment  = PciInfo->Segment;
+  Record->Bus      = PciInfo->Bus;
+  Record->Device   = PciInfo->Device;
+  Record->Function = PciInfo->Function;
+  Record->Flags    = PciInfo->Private->Flags;
+  return Record;
+}
+
+
+/**
+  Retrieve a copy of the UEFI memory map.
+
+  @param[out] Map             The memory map, allocated from pool. The caller
+                              is responsible for freeing it.
+
+  @param[out] MapSize         The size of Map in bytes.
+
+  @param[out] DescriptorSize  The size of a descriptor in Map.
+
+  @retval EFI_SUCCESS         The memory map has been retrieved.
+
+  @return                     Error codes from gBS->GetMemoryMap() and
+                              gBS->AllocatePool().
+**/
+STATIC
+EFI_STATUS
+GetMemoryMapCopy (
+  OUT EFI_MEMORY_DESCRIPTOR **Map,
+  OUT UINTN                 *MapSize,
+  OUT UINTN                 *DescriptorSize
+  )
+{
+  EFI_STATUS Status;
+  UINTN      MapKey;
+  UINT32     DescriptorVersion;
+
+  //
+  // Allocating the buffer may itself split a descriptor, hence the slack and
+  // the loop.
+  //
+  *MapSize = 0;
+  *Map     = NULL;
+  do {
+    Status = gBS->GetMemoryMap (MapSize, *Map, &MapKey, DescriptorSize,
+                    &DescriptorVersion);
+    if (Status == EFI_BUFFER_TOO_SMALL) {
+      if (*Map != NULL) {
+        gBS->FreePool (*Map);
+      }
+      *MapSize += 2 * *DescriptorSize;
+      Status = gBS->AllocatePool (EfiBootServicesData, *MapSize, (VOID **)Map);
+      if (EFI_ERROR (Status)) {
+        *Map = NULL;
+        return Status;
+      }
+      Status = EFI_BUFFER_TOO_SMALL;
+    }
+  } while (Status == EFI_BUFFER_TOO_SMALL);
+
+  if (EFI_ERROR (Status) && *Map != NULL) {
+    gBS->FreePool (*Map);
+    *Map = NULL;
+  }
+  return Status;
+}
+
+
+/**
+  Find the highest free range in the UEFI memory map that satisfies a size,
+  alignment and address limits.
+
+  @param[in] MinAddress        The lowest address that the range may include.
+
+  @param[in] MaxAddress        The highest address that the range may include.
+
+  @param[in] NumberOfPages     The size of the range in pages.
+
+  @param[in] AlignmentInPages  The required alignment of the range in pages, a
+                               power of two.
+
+  @param[out] Address          Base address of the range found.
+
+  @retval EFI_SUCCESS          A suitable range has been found.
+
+  @retval EFI_NOT_FOUND        No suitable range exists.
+
+  @return                      Error codes from gBS->GetMemoryMap() and
+                               gBS->AllocatePool().
+**/
+STATIC
+EFI_STATUS
+FindAlignedFreeRange (
+  IN  EFI_PHYSICAL_ADDRESS MinAddress,
+  IN  EFI_PHYSICAL_ADDRESS MaxAddress,
+  IN  UINTN                NumberOfPages,
+  IN  UINTN                AlignmentInPages,
+  OUT EFI_PHYSICAL_ADDRESS *Address
+  )
+{
+  EFI_STATUS            Status;
+  UINTN                 MapSize;
+  EFI_MEMORY_DESCRIPTOR *Map;
+  UINTN                 DescriptorSize;
+  EFI_MEMORY_DESCRIPTOR *Desc;
+  UINT64                Size;
+  UINT64                AlignMask;
+  EFI_PHYSICAL_ADDRESS  Bottom;
+  EFI_PHYSICAL_ADDRESS  Top;
+  EFI_PHYSICAL_ADDRESS  Candidate;
+  BOOLEAN               Found;
+
+  Size      = EFI_PAGES_TO_SIZE ((UINT64)NumberOfPages);
+  AlignMask = EFI_PAGES_TO_SIZE ((UINT64)AlignmentInPages) - 1;
+
+  Status = GetMemoryMapCopy (&Map, &MapSize, &DescriptorSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Pick the highest aligned range, like top-down allocation would.
+  //
+  Found = FALSE;
+  for (Desc = Map;
+       (UINT8 *)Desc < (UINT8 *)Map + MapSize;
+       Desc = NEXT_MEMORY_DESCRIPTOR (Desc, DescriptorSize)) {
+    if (Desc->Type != EfiConventionalMemory ||
+        Desc->PhysicalStart > MaxAddress ||
+        Desc->NumberOfPages < NumberOfPages) {
+      continue;
+    }
+    Top = Desc->PhysicalStart + EFI_PAGES_TO_SIZE (Desc->NumberOfPages) - 1;
+    Top = MIN (Top, MaxAddress);
+    Bottom = MAX (Desc->PhysicalStart, MinAddress);
+    if (Top < Bottom || Top - Bottom + 1 < Size) {
+      continue;
+    }
+    Candidate = (Top - Size + 1) & ~AlignMask;
+    if (Candidate < Bottom) {
+      continue;
+    }
+    if (!Found || Candidate > *Address) {
+      *Address = Candidate;
+      Found    = TRUE;
+    }
+  }
+  gBS->FreePool (Map);
+  return Found ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+
+/**
+  Check whether a range is entirely covered by memory map entries of a given
+  type.
+
+  @param[in] MemoryType     The memory type to look for.
+
+  @param[in] Address        Base address of the range.
+
+  @param[in] NumberOfPages  The size of the range in pages.
+
+  @retval TRUE   The range is covered by MemoryType.
+
+  @retval FALSE  The range is not covered by MemoryType, or the memory map
+                 could not be retrieved.
+**/
+STATIC
+BOOLEAN
+IsRangeOfMemoryType (
+  IN EFI_MEMORY_TYPE      MemoryType,
+  IN EFI_PHYSICAL_ADDRESS Address,
+  IN UINTN                NumberOfPages
+  )
+{
+  EFI_STATUS            Status;
+  UINTN                 MapSize;
+  EFI_MEMORY_DESCRIPTOR *Map;
+  UINTN                 DescriptorSize;
+  EFI_MEMORY_DESCRIPTOR *Desc;
+  EFI_PHYSICAL_ADDRESS  End;
+  EFI_PHYSICAL_ADDRESS  DescEnd;
+  UINT64                Covered;
+
+  Status = GetMemoryMapCopy (&Map, &MapSize, &DescriptorSize);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  //
+  // Memory map entries never overlap, so it suffices to add up the overlaps.
+  //
+  End     = Address + EFI_PAGES_TO_SIZE ((UINT64)NumberOfPages);
+  Covered = 0;
+  for (Desc = Map;
+       (UINT8 *)Desc < (UINT8 *)Map + MapSize;
+       Desc = NEXT_MEMORY_DESCRIPTOR (Desc, DescriptorSize)) {
+    if (Desc->Type != MemoryType) {
+      continue;
+    }
+    DescEnd = Desc->PhysicalStart + EFI_PAGES_TO_SIZE (Desc->NumberOfPages);
+    if (DescEnd <= Address || Desc->PhysicalStart >= End) {
+      continue;
+    }
+    Covered += MIN (DescEnd, End) - MAX (Desc->PhysicalStart, Address);
+  }
+
+  gBS->FreePool (Map);
+  return (BOOLEAN)(Covered == End - Address);
+}
+
+
+/**
+  Claim a range whose address has been chosen by the host.
+
+  @param[in] MemoryType     The memory type that the range should have.
+
+  @param[in] Address        Base address of the range.
+
+  @param[in] NumberOfPages  The size of the range in pages.
+
+  @param[out] Allocated     TRUE if the range has been allocated now, and must
+                            be freed on error. FALSE if the range was already
+                            of MemoryType, for example because the host
+                            reported it as reserved.
+
+  @retval EFI_SUCCESS       The range is of MemoryType now.
+
+  @return                   Error codes from gBS->AllocatePages().
+**/
+STATIC
+EFI_STATUS
+ClaimFixedRange (
+  IN  EFI_MEMORY_TYPE      MemoryType,
+  IN  EFI_PHYSICAL_ADDRESS Address,
+  IN  UINTN                NumberOfPages,
+  OUT BOOLEAN              *Allocated
+  )
+{
+  EFI_STATUS Status;
+
+  Status = gBS->AllocatePages (
+                  AllocateAddress,
+                  MemoryType,
+                  NumberOfPages,
+                  &Address
+                  );
+  if (!EFI_ERROR (Status)) {
+    *Allocated = TRUE;
+    return EFI_SUCCESS;
+  }
+  if (IsRangeOfMemoryType (MemoryType, Address, NumberOfPages)) {
+    *Allocated = FALSE;
+    return EFI_SUCCESS;
+  }
+  return Status;
+}
+
+
+/**
+  Record a PCI config space write in the S3 boot script, so that it is replayed
+  on S3 resume. Failure is not fatal; it is only logged.
+
+  @param[in,out] PciInfo  The device that has been written to. The function
+                          may call GetPciName() on PciInfo, possibly modifying
+                          it.
+
+  @param[in] Width        Width of the write. The boot script supports PCI
+                          config writes of up to 32 bits.
+
+  @param[in] Offset       Offset of the register in config space.
+
+  @param[in] Count        Number of consecutive Width units written.
+
+  @param[in] Buffer       The value that has been written.
+**/
+STATIC
+VOID
+SaveS3PciConfigWrite (
+  IN OUT CANDIDATE_PCI_INFO    *PciInfo,
+  IN     EFI_BOOT_SCRIPT_WIDTH Width,
+  IN     UINT32                Offset,
+  IN     UINTN                 Count,
+  IN     VOID                  *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_S3_SAVE_STATE_PROTOCOL *S3SaveState;
+
+  Status = gBS->LocateProtocol (
+                  &gEfiS3SaveStateProtocolGuid,
+                  NULL,                         // Registration
+                  (VOID **)&S3SaveState
+                  );
+  if (EFI_ERROR (Status)) {
+    //
+    // S3 is not supported on this platform.
+    //
+    return;
+  }
+
+  Status = S3SaveState->Write (
+                          S3SaveState,
+                          EFI_BOOT_SCRIPT_PCI_CONFIG2_WRITE_OPCODE,
+                          Width,
+                          (UINT16)PciInfo->Segment,
+                          (UINT64)EFI_PCI_ADDRESS (
+                                    PciInfo->Bus,
+                                    PciInfo->Device,
+                                    PciInfo->Function,
+                                    Offset
+                                    ),
+                          Count,
+                          Buffer
+                          );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "%a: %a: failed to save 0x%x to S3 boot script: %r\n",
+      __FUNCTION__, GetPciName (PciInfo), Offset, Status));
+  }
+}
+
+
+/**
+  Allocate memory between limits, with the requested UEFI memory type and the
+  requested alignment.
+
+  Page-aligned requests without a lower limit are left to gBS->AllocatePages(),
+  which serves them from the pages that DxeCore keeps for MemoryType, keeping
+  the memory map stable across boots. Those pages may lie below a lower limit,
+  so for other requests, the free range is located in the UEFI memory map and
+  claimed exactly, rather than over-allocating for alignment and releasing the
+  padding. This neither inflates the footprint temporarily, nor leaves holes in
+  the memory map.
 
   @param[in] MemoryType        Assign MemoryType to the allocated pages as
                                memory type.
 
+  @param[in] MinAddress        The lowest address that the allocated area may
+                               include.
+
+  @param[in] MaxAddress        The highest address that the allocated area may
+                               include.
+
   @param[in] NumberOfPages     The number of pages to allocate.
 
   @param[in] AlignmentInPages  On output, Address will be a whole multiple of
@@ -174,26 +899,29 @@ GetPciName (
 
   @retval EFI_INVALID_PARAMETER  AlignmentInPages is not a power of two (a
                                  special case of which is when AlignmentInPages
-                                 is zero).
+                                 is zero), or NumberOfPages is zero.
 
   @retval EFI_OUT_OF_RESOURCES   Integer overflow detected.
 
-  @return                        Error codes from gBS->AllocatePages().
+  @retval EFI_NOT_FOUND          No suitable free range exists.
+
+  @return                        Error codes from FindAlignedFreeRange() and
+                                 gBS->AllocatePages().
 **/
 STATIC
 EFI_STATUS
-Allocate32BitAlignedPagesWithType (
+AllocateAlignedPagesWithType (
   IN  EFI_MEMORY_TYPE      MemoryType,
+  IN  EFI_PHYSICAL_ADDRESS MinAddress,
+  IN  EFI_PHYSICAL_ADDRESS MaxAddress,
   IN  UINTN                NumberOfPages,
   IN  UINTN                AlignmentInPages,
   OUT EFI_PHYSICAL_ADDRESS *Address
   )
 {
   EFI_STATUS           Status;
-  EFI_PHYSICAL_ADDRESS PageAlignedAddress;
-  EFI_PHYSICAL_ADDRESS FullyAlignedAddress;
-  UINTN                BottomPages;
-  UINTN                TopPages;
+  EFI_PHYSICAL_ADDRESS Candidate;
+  UINTN                Retry;
 
   //
   // AlignmentInPages must be a power of two.
@@ -202,73 +930,280 @@ Allocate32BitAlignedPagesWithType (
       (AlignmentInPages & (AlignmentInPages - 1)) != 0) {
     return EFI_INVALID_PARAMETER;
   }
-  //
-  // (NumberOfPages + (AlignmentInPages - 1)) must not overflow UINTN.
-  //
-  if (AlignmentInPages - 1 > MAX_UINTN - NumberOfPages) {
-    return EFI_OUT_OF_RESOURCES;
+  if (NumberOfPages == 0) {
+    return EFI_INVALID_PARAMETER;
   }
   //
-  // EFI_PAGES_TO_SIZE (AlignmentInPages) must not overflow UINTN.
+  // EFI_PAGES_TO_SIZE (NumberOfPages) and EFI_PAGES_TO_SIZE (AlignmentInPages)
+  // must not overflow UINTN.
   //
-  if (AlignmentInPages > (MAX_UINTN >> EFI_PAGE_SHIFT)) {
+  if (NumberOfPages > (MAX_UINTN >> EFI_PAGE_SHIFT) ||
+      AlignmentInPages > (MAX_UINTN >> EFI_PAGE_SHIFT)) {
     return EFI_OUT_OF_RESOURCES;
   }
 
-  //
-  // Allocate with sufficient padding for alignment.
-  //
-  PageAlignedAddress = BASE_4GB - 1;
-  Status = gBS->AllocatePages (
-                  AllocateMaxAddress,
-                  MemoryType,
-                  NumberOfPages + (AlignmentInPages - 1),
-                  &PageAlignedAddress
-                  );
+  if (AlignmentInPages == 1 && MinAddress == 0) {
+    Candidate = MaxAddress;
+    Status = gBS->AllocatePages (
+                    AllocateMaxAddress,
+                    MemoryType,
+                    NumberOfPages,
+                    &Candidate
+                    );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    *Address = Candidate;
+    return EFI_SUCCESS;
+  }
+
+  for (Retry = 0; Retry < ALLOCATE_ALIGNED_RETRIES; Retry++) {
+    Status = FindAlignedFreeRange (
+               MinAddress,
+               MaxAddress,
+               NumberOfPages,
+               AlignmentInPages,
+               &Candidate
+               );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Status = gBS->AllocatePages (
+                    AllocateAddress,
+                    MemoryType,
+                    NumberOfPages,
+                    &Candidate
+                    );
+    if (!EFI_ERROR (Status)) {
+      *Address = Candidate;
+      return EFI_SUCCESS;
+    }
+    //
+    // EFI_NOT_FOUND means that the range has been taken in the meantime; look
+    // again.
+    //
+    if (Status != EFI_NOT_FOUND) {
+      return Status;
+    }
+  }
+  return Status;
+}
+
+
+/**
+  Allocate memory between limits, with the requested UEFI memory type and the
+  requested alignment, and optionally from the proximity domain requested by
+  the host only.
+
+  @param[in] MemoryType        Assign MemoryType to the allocated pages as
+                               memory type.
+
+  @param[in] NodeLocal         Whether to allocate from the memory of the
+                               requested proximity domain only.
+
+  @param[in] MinAddress        The lowest address that the allocated area may
+                               include.
+
+  @param[in] MaxAddress        The highest address that the allocated area may
+                               include.
+
+  @param[in] NumberOfPages     The number of pages to allocate.
+
+  @param[in] AlignmentInPages  On output, Address will be a whole multiple of
+                               EFI_PAGES_TO_SIZE (AlignmentInPages).
+                               AlignmentInPages must be a power of two.
+
+  @param[out] Address          Base address of the allocated area.
+
+  @retval EFI_SUCCESS          Allocation successful.
+
+  @retval EFI_NOT_FOUND        NodeLocal is TRUE, and the requested proximity
+                               domain has no suitable memory, or no domain has
+                               been requested.
+
+  @return                      Error codes from AllocateAlignedPagesWithType().
+**/
+STATIC
+EFI_STATUS
+AllocatePlacedPagesWithType (
+  IN  EFI_MEMORY_TYPE      MemoryType,
+  IN  BOOLEAN              NodeLocal,
+  IN  EFI_PHYSICAL_ADDRESS MinAddress,
+  IN  EFI_PHYSICAL_ADDRESS MaxAddress,
+  IN  UINTN                NumberOfPages,
+  IN  UINTN                AlignmentInPages,
+  OUT EFI_PHYSICAL_ADDRESS *Address
+  )
+{
+  EFI_STATUS           Status;
+  UINTN                Index;
+  EFI_PHYSICAL_ADDRESS Base;
+  EFI_PHYSICAL_ADDRESS Limit;
+
+  if (!NodeLocal) {
+    return AllocateAlignedPagesWithType (
+             MemoryType,
+             MinAddress,
+             MaxAddress,
+             NumberOfPages,
+             AlignmentInPages,
+             Address
+             );
+  }
+
+  Status = EFI_NOT_FOUND;
+  for (Index = 0; GetNumaRange (Index, &Base, &Limit); Index++) {
+    Base  = MAX (Base, MinAddress);
+    Limit = MIN (Limit, MaxAddress);
+    if (Base > Limit) {
+      continue;
+    }
+    Status = AllocateAlignedPagesWithType (
+               MemoryType,
+               Base,
+               Limit,
+               NumberOfPages,
+               AlignmentInPages,
+               Address
+               );
+    if (!EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_INFO, "%a: 0x%Lx pages @ 0x%Lx in NUMA range 0x%Lx-0x%Lx\n",
+        __FUNCTION__, (UINT64)NumberOfPages, *Address, Base, Limit));
+      return EFI_SUCCESS;
+    }
+  }
+  return Status;
+}
+
+
+/**
+  Expand an OpRegion from the ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS format.
+  Only the extents are transferred, the bytes between them are left alone.
+
+  @param[in] Source   The fw_cfg file to download the OpRegion from, with
+                      Source->Extents set.
+
+  @param[out] Buffer  The zero-filled OpRegion, of at least Source->Size bytes.
+
+  @retval EFI_SUCCESS         The extents have been copied into Buffer.
+
+  @retval EFI_PROTOCOL_ERROR  The file is malformed. The contents of Buffer are
+                              indeterminate.
+**/
+STATIC
+EFI_STATUS
+ReadOpRegionExtents (
+  IN  CONST OPREGION_SOURCE *Source,
+  OUT UINT8                 *Buffer
+  )
+{
+  UINTN                      Remaining;
+  UINTN                      Position;
+  ASSIGNED_IGD_FW_CFG_EXTENT Extent;
+  UINTN                      Extents;
+
+  QemuFwCfgSelectItem (Source->Item);
+  QemuFwCfgSkipBytes (sizeof (ASSIGNED_IGD_FW_CFG_EXTENTS_HEADER));
+  Remaining = Source->ItemSize - sizeof (ASSIGNED_IGD_FW_CFG_EXTENTS_HEADER);
+  Position  = 0;
+  Extents   = 0;
+
+  while (Remaining > 0) {
+    if (Remaining < sizeof Extent) {
+      return EFI_PROTOCOL_ERROR;
+    }
+    QemuFwCfgReadBytes (sizeof Extent, &Extent);
+    Remaining -= sizeof Extent;
+
+    if (Extent.Length > Remaining ||
+        Extent.Offset < Position ||
+        Extent.Offset > Source->Size ||
+        Extent.Length > Source->Size - Extent.Offset) {
+      DEBUG ((DEBUG_ERROR, "%a: invalid extent 0x%x+0x%x\n", __FUNCTION__,
+        Extent.Offset, Extent.Length));
+      return EFI_PROTOCOL_ERROR;
+    }
+    QemuFwCfgReadBytes (Extent.Length, Buffer + Extent.Offset);
+    Remaining -= Extent.Length;
+    Position   = Extent.Offset + Extent.Length;
+    Extents++;
+  }
+
+  DEBUG ((DEBUG_VERBOSE, "%a: %Lu extents, 0x%Lx of 0x%Lx bytes transferred\n",
+    __FUNCTION__, (UINT64)Extents, (UINT64)Source->ItemSize,
+    (UINT64)Source->Size));
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Claim the OpRegion that the host has mapped at mOpRegionRange.
+
+  @param[out] Address        Base address of the OpRegion.
+
+  @param[out] NumberOfPages  The size of the OpRegion in pages.
+
+  @param[out] Allocated      Whether the range has been allocated now, see
+                             ClaimFixedRange().
+
+  @retval EFI_SUCCESS        The OpRegion has been claimed as ACPI NVS.
+
+  @retval EFI_NOT_FOUND      The range doesn't start with an OpRegion header.
+                             The range has been released.
+
+  @return                    Error codes from ClaimFixedRange().
+**/
+STATIC
+EFI_STATUS
+ClaimHostOpRegion (
+  OUT EFI_PHYSICAL_ADDRESS *Address,
+  OUT UINTN                *NumberOfPages,
+  OUT BOOLEAN              *Allocated
+  )
+{
+  EFI_STATUS          Status;
+  IGD_OPREGION_HEADER *Header;
+
+  *Address       = mOpRegionRange.Base;
+  *NumberOfPages = EFI_SIZE_TO_PAGES ((UINTN)mOpRegionRange.Size);
+  Status = ClaimFixedRange (EfiACPIMemoryNVS, *Address, *NumberOfPages,
+             Allocated);
   if (EFI_ERROR (Status)) {
     return Status;
   }
-  FullyAlignedAddress = ALIGN_VALUE (
-                          PageAlignedAddress,
-                          (UINT64)EFI_PAGES_TO_SIZE (AlignmentInPages)
-                          );
 
-  //
-  // Release bottom and/or top padding.
-  //
-  BottomPages = EFI_SIZE_TO_PAGES (
-                  (UINTN)(FullyAlignedAddress - PageAlignedAddress)
-                  );
-  TopPages = (AlignmentInPages - 1) - BottomPages;
-  if (BottomPages > 0) {
-    Status = gBS->FreePages (PageAlignedAddress, BottomPages);
-    ASSERT_EFI_ERROR (Status);
-  }
-  if (TopPages > 0) {
-    Status = gBS->FreePages (
-                    FullyAlignedAddress + EFI_PAGES_TO_SIZE (NumberOfPages),
-                    TopPages
-                    );
-    ASSERT_EFI_ERROR (Status);
+  Header = (IGD_OPREGION_HEADER *)(UINTN)*Address;
+  if (CompareMem (Header->SIGN, IGD_OPREGION_HEADER_SIGN,
+        sizeof Header->SIGN) != 0) {
+    if (*Allocated) {
+      gBS->FreePages (*Address, *NumberOfPages);
+    }
+    return EFI_NOT_FOUND;
   }
-
-  *Address = FullyAlignedAddress;
   return EFI_SUCCESS;
 }
 
 
 /**
-  Set up the OpRegion for the device identified by PciIo.
+  Set up the OpRegion for the device identified by PciIo. The device at the
+  fixed location adopts the OpRegion mapped by the host, if there is one.
 
   @param[in] PciIo        The device to set up the OpRegion for.
 
   @param[in,out] PciInfo  On input, PciInfo must have been initialized from
-                          PciIo with InitPciInfo(). SetupOpRegion() may call
-                          GetPciName() on PciInfo, possibly modifying it.
+                          PciIo with InitPciInfo(), and PciInfo->Record must
+                          have been set. SetupOpRegion() may call GetPciName()
+                          on PciInfo, possibly modifying it, and records the
+                          OpRegion in PciInfo->Record.
+
+  @param[in] Source       The fw_cfg file to download the OpRegion from, if
+                          there is no OpRegion mapped by the host.
 
   @retval EFI_SUCCESS            OpRegion setup successful.
 
-  @retval EFI_INVALID_PARAMETER  mOpRegionSize is zero.
+  @retval EFI_INVALID_PARAMETER  Source->Size is zero, and there is no OpRegion
+                                 mapped by the host.
 
   @return                        Error codes propagated from underlying
                                  functions.
@@ -277,45 +1212,87 @@ STATIC
 EFI_STATUS
 SetupOpRegion (
   IN     EFI_PCI_IO_PROTOCOL *PciIo,
-  IN OUT CANDIDATE_PCI_INFO  *PciInfo
+  IN OUT CANDIDATE_PCI_INFO  *PciInfo,
+  IN     CONST OPREGION_SOURCE *Source
   )
 {
   UINTN                OpRegionPages;
   UINTN                OpRegionResidual;
+  UINTN                OpRegionSize;
+  BOOLEAN              Allocated;
   EFI_STATUS           Status;
   EFI_PHYSICAL_ADDRESS Address;
   UINT8                *BytePointer;
 
-  if (mOpRegionSize == 0) {
+  if (mOpRegionRange.Size > 0 && IsFixedIgdLocation (PciInfo)) {
+    Status = ClaimHostOpRegion (&Address, &OpRegionPages, &Allocated);
+    if (!EFI_ERROR (Status)) {
+      OpRegionSize = (UINTN)mOpRegionRange.Size;
+      BytePointer = (UINT8 *)(UINTN)Address;
+      goto WriteAsls;
+    }
+    DEBUG ((DEBUG_WARN, "%a: %a: failed to claim %a: %r, ignoring\n",
+      __FUNCTION__, GetPciName (PciInfo), ASSIGNED_IGD_FW_CFG_OPREGION_RANGE,
+      Status));
+  }
+
+  if (Source->Size == 0) {
     return EFI_INVALID_PARAMETER;
   }
-  OpRegionPages = EFI_SIZE_TO_PAGES (mOpRegionSize);
-  OpRegionResidual = EFI_PAGES_TO_SIZE (OpRegionPages) - mOpRegionSize;
+  OpRegionSize = Source->Size;
+  OpRegionPages = EFI_SIZE_TO_PAGES (OpRegionSize);
+  OpRegionResidual = EFI_PAGES_TO_SIZE (OpRegionPages) - OpRegionSize;
 
   //
   // While QEMU's "docs/igd-assign.txt" specifies reserved memory, Intel's IGD
   // OpRegion spec refers to ACPI NVS.
   //
-  Status = Allocate32BitAlignedPagesWithType (
+  Status = AllocatePlacedPagesWithType (
              EfiACPIMemoryNVS,
+             TRUE,             // NodeLocal
+             0,                // MinAddress
+             BASE_4GB - 1,
              OpRegionPages,
              1,                // AlignmentInPages
              &Address
              );
+  if (EFI_ERROR (Status)) {
+    Status = AllocatePlacedPagesWithType (
+               EfiACPIMemoryNVS,
+               FALSE,            // NodeLocal
+               0,                // MinAddress
+               BASE_4GB - 1,
+               OpRegionPages,
+               1,                // AlignmentInPages
+               &Address
+               );
+  }
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a: %a: failed to allocate OpRegion: %r\n",
       __FUNCTION__, GetPciName (PciInfo), Status));
     return Status;
   }
+  Allocated = TRUE;
 
   //
   // Download OpRegion contents from fw_cfg, zero out trailing portion.
   //
   BytePointer = (UINT8 *)(UINTN)Address;
-  QemuFwCfgSelectItem (mOpRegionItem);
-  QemuFwCfgReadBytes (mOpRegionSize, BytePointer);
-  ZeroMem (BytePointer + mOpRegionSize, OpRegionResidual);
+  if (Source->Extents) {
+    ZeroMem (BytePointer, EFI_PAGES_TO_SIZE (OpRegionPages));
+    Status = ReadOpRegionExtents (Source, BytePointer);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: %a: %r\n", __FUNCTION__,
+        GetPciName (PciInfo), ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS, Status));
+      goto FreeOpRegion;
+    }
+  } else {
+    QemuFwCfgSelectItem (Source->Item);
+    QemuFwCfgReadBytes (Source->Size, BytePointer);
+    ZeroMem (BytePointer + Source->Size, OpRegionResidual);
+  }
 
+WriteAsls:
   //
   // Write address of OpRegion to PCI config space.
   //
@@ -331,17 +1308,139 @@ SetupOpRegion (
       __FUNCTION__, GetPciName (PciInfo), Status));
     goto FreeOpRegion;
   }
+  SaveS3PciConfigWrite (
+    PciInfo,
+    EfiBootScriptWidthUint32,
+    ASSIGNED_IGD_PCI_ASLS_OFFSET,
+    1,                            // Count
+    &Address
+    );
+
+  PciInfo->Record->OpRegion      = Address;
+  PciInfo->Record->OpRegionPages = OpRegionPages;
 
   DEBUG ((DEBUG_INFO, "%a: %a: OpRegion @ 0x%Lx size 0x%Lx version %d.%d.%d\n",
     __FUNCTION__,
-    GetPciName (PciInfo), Address, (UINT64)mOpRegionSize,
+    GetPciName (PciInfo), Address, (UINT64)OpRegionSize,
     ((IGD_OPREGION_HEADER*)BytePointer)->OVER >> 24,
     ((IGD_OPREGION_HEADER*)BytePointer)->OVER >> 16 & 0xff,
     ((IGD_OPREGION_HEADER*)BytePointer)->OVER >> 8 & 0xff));
   return EFI_SUCCESS;
 
 FreeOpRegion:
-  gBS->FreePages (Address, OpRegionPages);
+  if (Allocated) {
+    gBS->FreePages (Address, OpRegionPages);
+  }
+  return Status;
+}
+
+
+//
+// Alignments to try for stolen memory, in decreasing order of preference.
+// Aligning both ends of the range to a large page boundary keeps the host and
+// the guest from having to split huge pages around stolen memory, but see
+// BDSM_ALIGN_WASTE_SHIFT.
+//
+STATIC CONST UINT64 mBdsmAlignments[] = {
+  SIZE_1GB,
+  SIZE_2MB,
+  ASSIGNED_IGD_BDSM_ALIGN
+};
+
+
+//
+// Placements to try for stolen memory, in decreasing order of preference.
+// Placement takes precedence over alignment: every alignment is tried above
+// 4GB before any is tried below.
+//
+typedef struct {
+  BOOLEAN Above4G;
+  BOOLEAN NodeLocal;
+} BDSM_PLACEMENT;
+
+STATIC CONST BDSM_PLACEMENT mBdsmPlacements[] = {
+  { TRUE,  TRUE  },
+  { TRUE,  FALSE },
+  { FALSE, TRUE  },
+  { FALSE, FALSE }
+};
+
+
+/**
+  Allocate stolen memory, trying the placements in mBdsmPlacements and the
+  alignments in mBdsmAlignments.
+
+  @param[in] Size              Size of stolen memory.
+
+  @param[in] PciInfo           PciInfo->Private determines whether stolen
+                               memory may be placed above 4GB.
+
+  @param[out] Address          Base address of the allocated area.
+
+  @param[out] NumberOfPages    Size of the allocated area in pages; Size rounded
+                               up to a whole multiple of Alignment.
+
+  @param[out] Alignment        The alignment that could be satisfied.
+
+  @retval EFI_SUCCESS          Allocation successful.
+
+  @return                      Error codes from AllocatePlacedPagesWithType().
+**/
+STATIC
+EFI_STATUS
+AllocateStolenMemory (
+  IN  UINTN                    Size,
+  IN  CONST CANDIDATE_PCI_INFO *PciInfo,
+  OUT EFI_PHYSICAL_ADDRESS     *Address,
+  OUT UINTN                    *NumberOfPages,
+  OUT UINT64                   *Alignment
+  )
+{
+  EFI_STATUS           Status;
+  BOOLEAN              Above4GAllowed;
+  UINTN                Placement;
+  UINTN                Index;
+  UINTN                Pages;
+
+  //
+  // A 64-bit BDSM register can point anywhere. If allowed, try to keep stolen
+  // memory out of the 32-bit address space.
+  //
+  Above4GAllowed = (BOOLEAN)(mBdsmAbove4G &&
+                             (PciInfo->Private->Flags & IGD_FLAG_BDSM_64BIT));
+
+  Status = EFI_OUT_OF_RESOURCES;
+  for (Placement = 0; Placement < ARRAY_SIZE (mBdsmPlacements); Placement++) {
+    if (mBdsmPlacements[Placement].Above4G && !Above4GAllowed) {
+      continue;
+    }
+    for (Index = 0; Index < ARRAY_SIZE (mBdsmAlignments); Index++) {
+      //
+      // Don't round stolen memory up to a much larger size, such as 1056MB to
+      // 2GB, or small stolen memory to a large page.
+      //
+      if (mBdsmAlignments[Index] > ASSIGNED_IGD_BDSM_ALIGN &&
+          ALIGN_VALUE (Size, mBdsmAlignments[Index]) - Size >
+          (Size >> BDSM_ALIGN_WASTE_SHIFT)) {
+        continue;
+      }
+      Pages = EFI_SIZE_TO_PAGES (ALIGN_VALUE (Size, mBdsmAlignments[Index]));
+      Status = AllocatePlacedPagesWithType (
+                 EfiReservedMemoryType,
+                 mBdsmPlacements[Placement].NodeLocal,
+                 mBdsmPlacements[Placement].Above4G ? BASE_4GB : 0,
+                 mBdsmPlacements[Placement].Above4G ? MAX_ADDRESS : BASE_4GB - 1,
+                 Pages,
+                 EFI_SIZE_TO_PAGES ((UINTN)mBdsmAlignments[Index]),
+                 Address
+                 );
+      if (!EFI_ERROR (Status)) {
+        *NumberOfPages = Pages;
+        *Alignment     = mBdsmAlignments[Index];
+        return EFI_SUCCESS;
+      }
+    }
+  }
   return Status;
 }
 
@@ -354,13 +1453,18 @@ FreeOpRegion:
   @param[in] Size         Size of stolen memory.
 
   @param[in,out] PciInfo  On input, PciInfo must have been initialized from
-                          PciIo with InitPciInfo(). SetupStolenMemory() may
-                          call GetPciName() on PciInfo, possibly modifying it.
+                          PciIo with InitPciInfo(), and PciInfo->Record must
+                          have been set. SetupStolenMemory() may call
+                          GetPciName() on PciInfo, possibly modifying it, and
+                          records stolen memory in PciInfo->Record.
 
   @retval EFI_SUCCESS            Stolen memory setup successful.
 
   @retval EFI_INVALID_PARAMETER  Stolen memory size is zero.
 
+  @retval EFI_UNSUPPORTED        The device has no BDSM register to program,
+                                 so no stolen memory is set up.
+
   @return                        Error codes propagated from underlying
                                  functions.
 **/
@@ -373,6 +1477,9 @@ SetupStolenMemory (
   )
 {
   UINTN                BdsmPages;
+  UINT64               Alignment;
+  BOOLEAN              Allocated;
+  BOOLEAN              HostRange;
   EFI_STATUS           Status;
   EFI_PHYSICAL_ADDRESS Address;
 
@@ -380,24 +1487,64 @@ SetupStolenMemory (
     return EFI_INVALID_PARAMETER;
   }
 
-  BdsmPages = EFI_SIZE_TO_PAGES (Size);
-
-  Status = Allocate32BitAlignedPagesWithType (
-             EfiReservedMemoryType,
-             BdsmPages,
-             EFI_SIZE_TO_PAGES ((UINTN)ASSIGNED_IGD_BDSM_ALIGN),
-             &Address
-             );
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "%a: %a: failed to allocate stolen memory: %r\n",
-      __FUNCTION__, GetPciName (PciInfo), Status));
-    return Status;
+  //
+  // Stolen memory that can't be pointed to would only waste guest RAM.
+  //
+  if ((PciInfo->Private->Flags &
+       (IGD_FLAG_BDSM_32BIT | IGD_FLAG_BDSM_64BIT)) == 0) {
+    DEBUG ((DEBUG_INFO, "%a: %a: no BDSM register, skipping stolen memory\n",
+      __FUNCTION__, GetPciName (PciInfo)));
+    return EFI_UNSUPPORTED;
   }
 
   //
-  // Zero out stolen memory.
+  // If the host has designated a range, simply claim it. The host is in charge
+  // of its contents, so don't clear it.
   //
-  ZeroMem ((VOID *)(UINTN)Address, EFI_PAGES_TO_SIZE (BdsmPages));
+  HostRange = FALSE;
+  if (mBdsmRange.Size > 0 && IsFixedIgdLocation (PciInfo)) {
+    if (mBdsmRange.Size < Size) {
+      DEBUG ((DEBUG_WARN, "%a: %a: %a smaller than stolen memory, ignoring\n",
+        __FUNCTION__, GetPciName (PciInfo), ASSIGNED_IGD_FW_CFG_BDSM_RANGE));
+    } else if ((PciInfo->Private->Flags & IGD_FLAG_BDSM_32BIT) &&
+               mBdsmRange.Base + mBdsmRange.Size > BASE_4GB) {
+      DEBUG ((DEBUG_WARN, "%a: %a: %a above 4GB, ignoring\n",
+        __FUNCTION__, GetPciName (PciInfo), ASSIGNED_IGD_FW_CFG_BDSM_RANGE));
+    } else {
+      Address   = mBdsmRange.Base;
+      BdsmPages = EFI_SIZE_TO_PAGES ((UINTN)mBdsmRange.Size);
+      Alignment = ASSIGNED_IGD_BDSM_ALIGN;
+      Status = ClaimFixedRange (EfiReservedMemoryType, Address, BdsmPages,
+                 &Allocated);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_WARN, "%a: %a: failed to claim %a: %r, ignoring\n",
+          __FUNCTION__, GetPciName (PciInfo), ASSIGNED_IGD_FW_CFG_BDSM_RANGE,
+          Status));
+      } else {
+        HostRange = TRUE;
+      }
+    }
+  }
+
+  if (!HostRange) {
+    Status = AllocateStolenMemory (Size, PciInfo, &Address, &BdsmPages,
+               &Alignment);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: failed to allocate stolen memory: %r\n",
+        __FUNCTION__, GetPciName (PciInfo), Status));
+      return Status;
+    }
+    Allocated = TRUE;
+
+    //
+    // Zero out stolen memory, unless the host told us that guest RAM is known
+    // to be zero-filled. Writing the pages would force the host to populate
+    // them.
+    //
+    if (mBdsmClear) {
+      ClearLargeMemory ((VOID *)(UINTN)Address, EFI_PAGES_TO_SIZE (BdsmPages));
+    }
+  }
 
   //
   // Write address of stolen memory to PCI config space.
@@ -425,16 +1572,163 @@ SetupStolenMemory (
     goto FreeStolenMemory;
   }
 
-  DEBUG ((DEBUG_INFO, "%a: %a: stolen memory @ 0x%Lx, size %d MB\n",
-    __FUNCTION__, GetPciName (PciInfo), Address, Size / SIZE_1MB));
+  if (PciInfo->Private->Flags & IGD_FLAG_BDSM_32BIT) {
+    SaveS3PciConfigWrite (
+      PciInfo,
+      EfiBootScriptWidthUint32,
+      ASSIGNED_IGD_PCI_BDSM_OFFSET,
+      1,                            // Count
+      &Address
+      );
+  } else if (PciInfo->Private->Flags & IGD_FLAG_BDSM_64BIT) {
+    //
+    // Record the 64-bit register as its low and high dwords.
+    //
+    SaveS3PciConfigWrite (
+      PciInfo,
+      EfiBootScriptWidthUint32,
+      ASSIGNED_IGD_PCI_BDSM64_OFFSET,
+      2,                            // Count
+      &Address
+      );
+  }
+
+  PciInfo->Record->Bdsm      = Address;
+  PciInfo->Record->BdsmPages = BdsmPages;
+
+  DEBUG ((DEBUG_INFO, "%a: %a: stolen memory @ 0x%Lx, size %d MB%a\n",
+    __FUNCTION__, GetPciName (PciInfo), Address, Size / SIZE_1MB,
+    HostRange ? ", designated by host" : mBdsmClear ? "" : ", not cleared"));
+  DEBUG ((DEBUG_INFO, "%a: %a: stolen memory reserved %Lu KB, aligned to "
+    "%Lu KB, mappable with %a pages\n", __FUNCTION__, GetPciName (PciInfo),
+    (UINT64)EFI_PAGES_TO_SIZE (BdsmPages) / SIZE_1KB, Alignment / SIZE_1KB,
+    Alignment >= SIZE_1GB ? "1GB" : Alignment >= SIZE_2MB ? "2MB" : "4KB"));
   return EFI_SUCCESS;
 
 FreeStolenMemory:
-  gBS->FreePages (Address, BdsmPages);
+  if (Allocated) {
+    gBS->FreePages (Address, BdsmPages);
+  }
   return Status;
 }
 
 
+/**
+  Point a device that has been set up before at its existing OpRegion and
+  stolen memory again, instead of making new reservations.
+
+  @param[in] PciIo        The device to program.
+
+  @param[in,out] PciInfo  On input, PciInfo must have been initialized from
+                          PciIo with InitPciInfo(), and PciInfo->Record must
+                          have been set. The function may call GetPciName() on
+                          PciInfo, possibly modifying it.
+**/
+STATIC
+VOID
+RestoreDevice (
+  IN     EFI_PCI_IO_PROTOCOL *PciIo,
+  IN OUT CANDIDATE_PCI_INFO  *PciInfo
+  )
+{
+  IGD_DEVICE_RECORD *Record;
+  EFI_STATUS        Status;
+
+  Record = PciInfo->Record;
+  Status = EFI_SUCCESS;
+
+  if (Record->OpRegion != 0) {
+    Status = PciIo->Pci.Write (
+                          PciIo,
+                          EfiPciIoWidthUint32,
+                          ASSIGNED_IGD_PCI_ASLS_OFFSET,
+                          1,                            // Count
+                          &Record->OpRegion
+                          );
+  }
+  if (!EFI_ERROR (Status) && Record->Bdsm != 0) {
+    if (Record->Flags & IGD_FLAG_BDSM_32BIT) {
+      Status = PciIo->Pci.Write (
+                            PciIo,
+                            EfiPciIoWidthUint32,
+                            ASSIGNED_IGD_PCI_BDSM_OFFSET,
+                            1,                            // Count
+                            &Record->Bdsm
+                            );
+    } else if (Record->Flags & IGD_FLAG_BDSM_64BIT) {
+      Status = PciIo->Pci.Write (
+                            PciIo,
+                            EfiPciIoWidthUint64,
+                            ASSIGNED_IGD_PCI_BDSM64_OFFSET,
+                            1,                            // Count
+                            &Record->Bdsm
+                            );
+    }
+  }
+
+  DEBUG ((EFI_ERROR (Status) ? DEBUG_ERROR : DEBUG_INFO,
+    "%a: %a: reusing OpRegion @ 0x%Lx, stolen memory @ 0x%Lx: %r\n",
+    __FUNCTION__, GetPciName (PciInfo), Record->OpRegion, Record->Bdsm,
+    Status));
+}
+
+
+/**
+  Publish what has been set up for a device as IGD_CONTEXT_PROTOCOL on its
+  handle, unless nothing has been set up.
+
+  @param[in] Handle  The handle of the device's PciIo instance.
+
+  @param[in] Record  The record of the device.
+**/
+STATIC
+VOID
+PublishIgdContext (
+  IN EFI_HANDLE        Handle,
+  IN IGD_DEVICE_RECORD *Record
+  )
+{
+  IGD_CONTEXT_PROTOCOL *Context;
+  EFI_STATUS           Status;
+
+  if ((Record->OpRegion == 0 && Record->Bdsm == 0) ||
+      Record->ContextHandle == Handle) {
+    return;
+  }
+
+  Context = &Record->Context;
+  Context->Revision     = IGD_CONTEXT_PROTOCOL_REVISION;
+  Context->Segment      = Record->Segment;
+  Context->Bus          = Record->Bus;
+  Context->Device       = Record->Device;
+  Context->Function     = Record->Function;
+  Context->Flags        = 0;
+  if (Record->Flags & IGD_FLAG_BDSM_32BIT) {
+    Context->Flags |= IGD_CONTEXT_BDSM_32BIT;
+  }
+  if (Record->Flags & IGD_FLAG_BDSM_64BIT) {
+    Context->Flags |= IGD_CONTEXT_BDSM_64BIT;
+  }
+  Context->OpRegion     = Record->OpRegion;
+  Context->OpRegionSize = EFI_PAGES_TO_SIZE (Record->OpRegionPages);
+  Context->Bdsm         = Record->Bdsm;
+  Context->BdsmSize     = EFI_PAGES_TO_SIZE (Record->BdsmPages);
+
+  Status = gBS->InstallProtocolInterface (
+                  &Handle,
+                  &gIgdContextProtocolGuid,
+                  EFI_NATIVE_INTERFACE,
+                  Context
+                  );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "%a: InstallProtocolInterface: %r\n", __FUNCTION__,
+      Status));
+    return;
+  }
+  Record->ContextHandle = Handle;
+}
+
+
 /**
   Process any PciIo protocol instances that may have been installed since the
   last invocation.
@@ -451,15 +1745,42 @@ PciIoNotify (
   IN VOID      *Context
   )
 {
+  EFI_HANDLE          Handle;
+  UINTN               HandleSize;
   EFI_PCI_IO_PROTOCOL *PciIo;
 
-  while (!EFI_ERROR (gBS->LocateProtocol (
-                            &gEfiPciIoProtocolGuid,
-                            mPciIoTracker,
-                            (VOID **)&PciIo
-                            ))) {
+  for (;;) {
     EFI_STATUS         Status;
-    CANDIDATE_PCI_INFO PciInfo;
+    CANDIDATE_PCI_INFO   PciInfo;
+    BOOLEAN              OpRegionDone;
+    BOOLEAN              StolenMemoryDone;
+    OPREGION_SOURCE      OpRegion;
+    UINT64               DeviceBdsmSize;
+    UINTN                StolenSize;
+    CONST IGD_PRIVATE_DATA *BuiltinPrivate;
+
+    //
+    // Fetch the next new handle; only one is returned at a time.
+    //
+    HandleSize = sizeof Handle;
+    Status = gBS->LocateHandle (
+                    ByRegisterNotify,
+                    NULL,               // Protocol
+                    mPciIoTracker,
+                    &HandleSize,
+                    &Handle
+                    );
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+    Status = gBS->HandleProtocol (
+                    Handle,
+                    &gEfiPciIoProtocolGuid,
+                    (VOID **)&PciIo
+                    );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
 
     Status = InitPciInfo (PciIo, &PciInfo);
     if (EFI_ERROR (Status)) {
@@ -468,6 +1789,32 @@ PciIoNotify (
       continue;
     }
 
+    //
+    // If the device has been set up before, reuse its reservations. This needs
+    // no config space reads. If setup failed in part, retry the missing parts
+    // below.
+    //
+    PciInfo.Record = FindDeviceRecord (&PciInfo);
+    if (PciInfo.Record != NULL) {
+      if (PciInfo.Record->OpRegion != 0 || PciInfo.Record->Bdsm != 0) {
+        RestoreDevice (PciIo, &PciInfo);
+      }
+      if (PciInfo.Record->Complete) {
+        PublishIgdContext (Handle, PciInfo.Record);
+        continue;
+      }
+    }
+
+    Status = ReadPciIds (PciIo, &PciInfo);
+    if (Status == EFI_UNSUPPORTED) {
+      continue;
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: ReadPciIds: %r\n", __FUNCTION__,
+        GetPciName (&PciInfo), Status));
+      continue;
+    }
+
     //
     // Check VendorId and ClassCode. These checks are necessary for both
     // OpRegion and stolen memory setup.
@@ -481,35 +1828,155 @@ PciIoNotify (
     }
 
     //
-    // Check device generation
+    // Check device generation. The host's description of the IGD at the fixed
+    // location takes precedence over the built-in table.
     //
-    Status = GetIgdPrivateData (PciInfo.DeviceId, &PciInfo.Private);
-    if (EFI_ERROR (Status)) {
-      DEBUG ((DEBUG_ERROR, "%a: GetIgdPrivateData: %r\n", __FUNCTION__, Status));
+    if (mHostPrivateValid && IsFixedIgdLocation (&PciInfo)) {
+      //
+      // Without a StolenSize from the host, fall back to the built-in GMCH
+      // decoder of the device, if there is one.
+      //
+      if (mHostPrivate.GetStolenSize == NULL &&
+          !EFI_ERROR (GetIgdPrivateData (PciInfo.DeviceId, &BuiltinPrivate))) {
+        mHostPrivate.GetStolenSize = BuiltinPrivate->GetStolenSize;
+      }
+      PciInfo.Private = &mHostPrivate;
+    } else {
+      Status = GetIgdPrivateData (PciInfo.DeviceId, &PciInfo.Private);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "%a: GetIgdPrivateData: %r\n", __FUNCTION__,
+          Status));
+        continue;
+      }
+    }
+
+    //
+    // Virtual functions need neither an OpRegion nor stolen memory. Don't
+    // record them either, a later instance is rejected just as cheaply.
+    //
+    if (IsVirtualFunction (PciIo, &PciInfo)) {
+      DEBUG ((DEBUG_INFO, "%a: %a: SR-IOV VF, skipping\n", __FUNCTION__,
+        GetPciName (&PciInfo)));
       continue;
     }
 
-    if (mOpRegionSize > 0) {
-      SetupOpRegion (PciIo, &PciInfo);
+    if (PciInfo.Record == NULL) {
+      PciInfo.Record = AddDeviceRecord (&PciInfo);
+      if (PciInfo.Record == NULL) {
+        DEBUG ((DEBUG_ERROR, "%a: %a: too many devices\n", __FUNCTION__,
+          GetPciName (&PciInfo)));
+        continue;
+      }
     }
 
     //
-    // Check Bus:Device.Function (Segment is ignored). This is necessary before
-    // stolen memory setup.
+    // A per-device OpRegion takes precedence over the shared one. Parts that
+    // an earlier attempt has set up are kept.
     //
-    if (PciInfo.Bus != ASSIGNED_IGD_PCI_BUS ||
-        PciInfo.Device != ASSIGNED_IGD_PCI_DEVICE ||
-        PciInfo.Function != ASSIGNED_IGD_PCI_FUNCTION) {
-      continue;
+    OpRegionDone = TRUE;
+    if (PciInfo.Record->OpRegion == 0) {
+      Status = FindDeviceFile (ASSIGNED_IGD_FW_CFG_OPREGION_DIR, &PciInfo,
+                 &OpRegion.Item, &OpRegion.ItemSize);
+      if (!EFI_ERROR (Status) && OpRegion.ItemSize > 0) {
+        OpRegion.Size    = OpRegion.ItemSize;
+        OpRegion.Extents = FALSE;
+        OpRegionDone = !EFI_ERROR (SetupOpRegion (PciIo, &PciInfo, &OpRegion));
+      } else if (mOpRegion.Size > 0 ||
+                 (mOpRegionRange.Size > 0 && IsFixedIgdLocation (&PciInfo))) {
+        OpRegionDone = !EFI_ERROR (SetupOpRegion (PciIo, &PciInfo,
+                                     &mOpRegion));
+      }
+    }
+
+    //
+    // A device with a per-device stolen memory size gets stolen memory
+    // wherever it is. Otherwise, only the device at the fixed location does;
+    // for it, prefer the stolen memory size that the host passed in via
+    // fw_cfg, and decode the GMCH register only in its absence. A
+    // host-designated range implies the size as a last resort.
+    //
+    StolenSize = 0;
+    DeviceBdsmSize = (PciInfo.Record->Bdsm == 0) ?
+                     GetDeviceBdsmSize (&PciInfo) : 0;
+    if (PciInfo.Record->Bdsm != 0) {
+      //
+      // Set up by an earlier attempt.
+      //
+    } else if (DeviceBdsmSize > 0) {
+      StolenSize = (UINTN)DeviceBdsmSize;
+    } else if (!IsFixedIgdLocation (&PciInfo)) {
+      //
+      // Other devices get no stolen memory.
+      //
+    } else if (mBdsmSize > 0) {
+      StolenSize = (UINTN)mBdsmSize;
+    } else if (PciInfo.Private->GetStolenSize) {
+      StolenSize = PciInfo.Private->GetStolenSize (PciIo);
+    } else if (mBdsmRange.Size > 0) {
+      StolenSize = (UINTN)mBdsmRange.Size;
+    }
+
+    //
+    // A device without a BDSM register is done without stolen memory.
+    //
+    StolenMemoryDone = TRUE;
+    if (StolenSize > 0) {
+      Status = SetupStolenMemory (PciIo, StolenSize, &PciInfo);
+      StolenMemoryDone = (BOOLEAN)(!EFI_ERROR (Status) ||
+                                   Status == EFI_UNSUPPORTED);
     }
 
-    if (PciInfo.Private->GetStolenSize) {
-      SetupStolenMemory (PciIo, PciInfo.Private->GetStolenSize (PciIo) ,&PciInfo);
+    //
+    // There is only one IGD at the fixed location. Once it has been set up
+    // completely, stop listening to further PciIo installations, unless
+    // per-device files announce more devices. Closing the event also releases
+    // mPciIoTracker, so don't look for more handles.
+    //
+    PciInfo.Record->Complete = (BOOLEAN)(OpRegionDone && StolenMemoryDone);
+    PublishIgdContext (Handle, PciInfo.Record);
+
+    if (mDeviceFileCount == 0 && IsFixedIgdLocation (&PciInfo) &&
+        PciInfo.Record->Complete) {
+      DEBUG ((DEBUG_INFO, "%a: %a: done, closing PciIo notification\n",
+        __FUNCTION__, GetPciName (&PciInfo)));
+      gBS->CloseEvent (mPciIoEvent);
+      mPciIoEvent = NULL;
+      break;
     }
   }
 }
 
 
+/**
+  Parse an optional boolean fw_cfg knob.
+
+  @param[in] Name        Name of the fw_cfg file.
+
+  @param[in,out] Value   On input, the default value. On output, the value of
+                         the knob if it is present and well-formed, otherwise
+                         unchanged.
+**/
+STATIC
+VOID
+ParseBoolKnob (
+  IN     CONST CHAR8 *Name,
+  IN OUT BOOLEAN     *Value
+  )
+{
+  EFI_STATUS           Status;
+  BOOLEAN              Knob;
+
+  Status = IgdFwCfgParseBool (Name, &Knob);
+  if (!EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "%a: %a: %d\n", __FUNCTION__, Name, Knob));
+    *Value = Knob;
+  } else if (Status != EFI_NOT_FOUND) {
+    DEBUG ((DEBUG_ERROR, "%a: %a: %r, ignoring\n", __FUNCTION__, Name,
+      Status));
+  }
+}
+
+
 /**
   Entry point for this driver.
 
@@ -533,29 +2000,253 @@ IgdAssignmentEntry (
   )
 {
   EFI_STATUS           OpRegionStatus;
+  EFI_STATUS           BdsmStatus;
+  FIRMWARE_CONFIG_ITEM BdsmItem;
+  UINTN                BdsmItemSize;
+  EFI_STATUS           BdsmRangeStatus;
+  FIRMWARE_CONFIG_ITEM BdsmRangeItem;
+  UINTN                BdsmRangeItemSize;
+  EFI_STATUS           DeviceInfoStatus;
+  FIRMWARE_CONFIG_ITEM DeviceInfoItem;
+  UINTN                DeviceInfoItemSize;
+  EFI_STATUS           OpRegionRangeStatus;
+  FIRMWARE_CONFIG_ITEM OpRegionRangeItem;
+  UINTN                OpRegionRangeItemSize;
   EFI_STATUS           Status;
-  EFI_EVENT            PciIoEvent;
+  BOOLEAN              SriovVf;
 
-  OpRegionStatus = QemuFwCfgFindFile (
-                     ASSIGNED_IGD_FW_CFG_OPREGION,
-                     &mOpRegionItem,
-                     &mOpRegionSize
-                     );
+  //
+  // Read the fw_cfg directory once; all lookups below, and in PciIoNotify(),
+  // are served from the index.
+  //
+  Status = InitFwCfgIndex ();
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // A guest with only VFs assigned needs nothing from this driver; don't even
+  // look up the other fw_cfg files.
+  //
+  SriovVf = FALSE;
+  ParseBoolKnob (ASSIGNED_IGD_FW_CFG_SRIOV_VF, &SriovVf);
+  if (SriovVf) {
+    Status = EFI_UNSUPPORTED;
+    goto FreeFwCfgIndex;
+  }
 
   //
-  // If neither fw_cfg file is available, assume no IGD is assigned.
+  // Prefer the sparse encoding of the OpRegion, which transfers fewer bytes.
   //
+  mOpRegion.Extents = TRUE;
+  OpRegionStatus = IgdFwCfgFindFile (
+                     ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS,
+                     &mOpRegion.Item,
+                     &mOpRegion.ItemSize
+                     );
   if (EFI_ERROR (OpRegionStatus)) {
-    return EFI_UNSUPPORTED;
+    mOpRegion.Extents = FALSE;
+    OpRegionStatus = IgdFwCfgFindFile (
+                       ASSIGNED_IGD_FW_CFG_OPREGION,
+                       &mOpRegion.Item,
+                       &mOpRegion.ItemSize
+                       );
+  }
+  BdsmStatus = IgdFwCfgFindFile (
+                 ASSIGNED_IGD_FW_CFG_BDSM_SIZE,
+                 &BdsmItem,
+                 &BdsmItemSize
+                 );
+
+  BdsmRangeStatus = IgdFwCfgFindFile (
+                      ASSIGNED_IGD_FW_CFG_BDSM_RANGE,
+                      &BdsmRangeItem,
+                      &BdsmRangeItemSize
+                      );
+
+  DeviceInfoStatus = IgdFwCfgFindFile (
+                       ASSIGNED_IGD_FW_CFG_DEVICE_INFO,
+                       &DeviceInfoItem,
+                       &DeviceInfoItemSize
+                       );
+
+  OpRegionRangeStatus = IgdFwCfgFindFile (
+                          ASSIGNED_IGD_FW_CFG_OPREGION_RANGE,
+                          &OpRegionRangeItem,
+                          &OpRegionRangeItemSize
+                          );
+
+  mDeviceFileCount = IgdFwCfgCountFiles (ASSIGNED_IGD_FW_CFG_OPREGION_DIR) +
+                     IgdFwCfgCountFiles (ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR);
+
+  //
+  // If none of the fw_cfg files is available, assume no IGD is assigned.
+  //
+  if (EFI_ERROR (OpRegionStatus) && EFI_ERROR (BdsmStatus) &&
+      EFI_ERROR (BdsmRangeStatus) && EFI_ERROR (DeviceInfoStatus) &&
+      EFI_ERROR (OpRegionRangeStatus) && mDeviceFileCount == 0) {
+    Status = EFI_UNSUPPORTED;
+    goto FreeFwCfgIndex;
   }
 
   //
   // Require all fw_cfg files that are present to be well-formed.
   //
-  if (mOpRegionSize == 0)  {
+  if (!EFI_ERROR (OpRegionStatus) && mOpRegion.Extents) {
+    ASSIGNED_IGD_FW_CFG_EXTENTS_HEADER Header;
+
+    if (mOpRegion.ItemSize < sizeof Header) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid fw_cfg size: %Lu\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS, (UINT64)mOpRegion.ItemSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    QemuFwCfgSelectItem (mOpRegion.Item);
+    QemuFwCfgReadBytes (sizeof Header, &Header);
+    if (Header.Size < sizeof (IGD_OPREGION_HEADER) ||
+        Header.Size > OPREGION_EXTENTS_SIZE_MAX) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid OpRegion size: 0x%x\n",
+        __FUNCTION__, ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS, Header.Size));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    mOpRegion.Size = Header.Size;
+    DEBUG ((DEBUG_INFO, "%a: %a: 0x%Lx bytes for a 0x%Lx byte OpRegion\n",
+      __FUNCTION__, ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS,
+      (UINT64)mOpRegion.ItemSize, (UINT64)mOpRegion.Size));
+  } else if (!EFI_ERROR (OpRegionStatus)) {
+    mOpRegion.Size = mOpRegion.ItemSize;
+  }
+
+  if (!EFI_ERROR (OpRegionStatus) && mOpRegion.Size == 0)  {
     DEBUG ((DEBUG_ERROR, "%a: %a: zero size\n", __FUNCTION__,
+      mOpRegion.Extents ? ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS :
       ASSIGNED_IGD_FW_CFG_OPREGION));
-    return EFI_PROTOCOL_ERROR;
+    Status = EFI_PROTOCOL_ERROR;
+    goto FreeFwCfgIndex;
+  }
+
+  if (!EFI_ERROR (OpRegionRangeStatus)) {
+    if (OpRegionRangeItemSize != sizeof mOpRegionRange) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid fw_cfg size: %Lu\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_OPREGION_RANGE, (UINT64)OpRegionRangeItemSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    QemuFwCfgSelectItem (OpRegionRangeItem);
+    QemuFwCfgReadBytes (OpRegionRangeItemSize, &mOpRegionRange);
+    if (mOpRegionRange.Size < sizeof (IGD_OPREGION_HEADER) ||
+        (mOpRegionRange.Base & EFI_PAGE_MASK) != 0 ||
+        (mOpRegionRange.Size & EFI_PAGE_MASK) != 0 ||
+        mOpRegionRange.Base >= BASE_4GB ||
+        mOpRegionRange.Size > BASE_4GB - mOpRegionRange.Base) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid range 0x%Lx+0x%Lx\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_OPREGION_RANGE, mOpRegionRange.Base,
+        mOpRegionRange.Size));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    DEBUG ((DEBUG_INFO, "%a: %a: 0x%Lx+0x%Lx\n", __FUNCTION__,
+      ASSIGNED_IGD_FW_CFG_OPREGION_RANGE, mOpRegionRange.Base,
+      mOpRegionRange.Size));
+  }
+
+  if (!EFI_ERROR (BdsmStatus)) {
+    if (BdsmItemSize != sizeof mBdsmSize) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid fw_cfg size: %Lu\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_BDSM_SIZE, (UINT64)BdsmItemSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    QemuFwCfgSelectItem (BdsmItem);
+    QemuFwCfgReadBytes (BdsmItemSize, &mBdsmSize);
+    if (mBdsmSize == 0 || mBdsmSize > MAX_UINTN) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid value: 0x%Lx\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_BDSM_SIZE, mBdsmSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    DEBUG ((DEBUG_INFO, "%a: %a: 0x%Lx\n", __FUNCTION__,
+      ASSIGNED_IGD_FW_CFG_BDSM_SIZE, mBdsmSize));
+  }
+
+  if (!EFI_ERROR (BdsmRangeStatus)) {
+    if (BdsmRangeItemSize != sizeof mBdsmRange) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid fw_cfg size: %Lu\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_BDSM_RANGE, (UINT64)BdsmRangeItemSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    QemuFwCfgSelectItem (BdsmRangeItem);
+    QemuFwCfgReadBytes (BdsmRangeItemSize, &mBdsmRange);
+    if (mBdsmRange.Size == 0 || mBdsmRange.Size > MAX_UINTN ||
+        (mBdsmRange.Base & (ASSIGNED_IGD_BDSM_ALIGN - 1)) != 0 ||
+        (mBdsmRange.Size & EFI_PAGE_MASK) != 0 ||
+        mBdsmRange.Base + mBdsmRange.Size < mBdsmRange.Base) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid range 0x%Lx+0x%Lx\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_BDSM_RANGE, mBdsmRange.Base, mBdsmRange.Size));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    DEBUG ((DEBUG_INFO, "%a: %a: 0x%Lx+0x%Lx\n", __FUNCTION__,
+      ASSIGNED_IGD_FW_CFG_BDSM_RANGE, mBdsmRange.Base, mBdsmRange.Size));
+  }
+
+  if (!EFI_ERROR (DeviceInfoStatus)) {
+    ASSIGNED_IGD_FW_CFG_DEVICE_INFO DeviceInfo;
+
+    if (DeviceInfoItemSize != sizeof DeviceInfo) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid fw_cfg size: %Lu\n", __FUNCTION__,
+        ASSIGNED_IGD_FW_CFG_DEVICE_INFO, (UINT64)DeviceInfoItemSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    QemuFwCfgSelectItem (DeviceInfoItem);
+    QemuFwCfgReadBytes (DeviceInfoItemSize, &DeviceInfo);
+    if (DeviceInfo.Flags == (ASSIGNED_IGD_DEVICE_INFO_BDSM_32BIT |
+                             ASSIGNED_IGD_DEVICE_INFO_BDSM_64BIT) ||
+        (DeviceInfo.Flags & ~(UINT32)(ASSIGNED_IGD_DEVICE_INFO_BDSM_32BIT |
+                                      ASSIGNED_IGD_DEVICE_INFO_BDSM_64BIT)) != 0 ||
+        (DeviceInfo.Flags == 0 && DeviceInfo.StolenSize != 0) ||
+        DeviceInfo.StolenSize > MAX_UINTN) {
+      DEBUG ((DEBUG_ERROR, "%a: %a: invalid flags 0x%x or size 0x%Lx\n",
+        __FUNCTION__, ASSIGNED_IGD_FW_CFG_DEVICE_INFO, DeviceInfo.Flags,
+        DeviceInfo.StolenSize));
+      Status = EFI_PROTOCOL_ERROR;
+      goto FreeFwCfgIndex;
+    }
+    DEBUG ((DEBUG_INFO, "%a: %a: gen %u, flags 0x%x, size 0x%Lx\n",
+      __FUNCTION__, ASSIGNED_IGD_FW_CFG_DEVICE_INFO, DeviceInfo.Generation,
+      DeviceInfo.Flags, DeviceInfo.StolenSize));
+
+    mHostPrivate.Flags = 0;
+    if ((DeviceInfo.Flags & ASSIGNED_IGD_DEVICE_INFO_BDSM_32BIT) != 0) {
+      mHostPrivate.Flags |= IGD_FLAG_BDSM_32BIT;
+    }
+    if ((DeviceInfo.Flags & ASSIGNED_IGD_DEVICE_INFO_BDSM_64BIT) != 0) {
+      mHostPrivate.Flags |= IGD_FLAG_BDSM_64BIT;
+    }
+    //
+    // The built-in GMCH decoder is looked up once the device ID is known.
+    //
+    mHostPrivate.GetStolenSize = NULL;
+    mHostPrivateValid = TRUE;
+
+    if (mBdsmSize == 0) {
+      mBdsmSize = DeviceInfo.StolenSize;
+    }
+  }
+
+  //
+  // Optional knobs; a missing knob keeps the default.
+  //
+  ParseBoolKnob (ASSIGNED_IGD_FW_CFG_BDSM_CLEAR, &mBdsmClear);
+  ParseBoolKnob (ASSIGNED_IGD_FW_CFG_BDSM_ABOVE_4G, &mBdsmAbove4G);
+
+  Status = InitNumaPlacement ();
+  if (EFI_ERROR (Status) && Status != EFI_NOT_FOUND) {
+    DEBUG ((DEBUG_ERROR, "%a: %a: %r, ignoring\n", __FUNCTION__,
+      ASSIGNED_IGD_FW_CFG_NUMA_NODE, Status));
   }
 
   //
@@ -566,14 +2257,14 @@ IgdAssignmentEntry (
                   TPL_CALLBACK,
                   PciIoNotify,
                   NULL,              // Context
-                  &PciIoEvent
+                  &mPciIoEvent
                   );
   if (EFI_ERROR (Status)) {
-    return Status;
+    goto FreeFwCfgIndex;
   }
   Status = gBS->RegisterProtocolNotify (
                   &gEfiPciIoProtocolGuid,
-                  PciIoEvent,
+                  mPciIoEvent,
                   &mPciIoTracker
                   );
   if (EFI_ERROR (Status)) {
@@ -583,15 +2274,28 @@ IgdAssignmentEntry (
   //
   // Kick the event for any existent PciIo protocol instances.
   //
-  Status = gBS->SignalEvent (PciIoEvent);
+  Status = gBS->SignalEvent (mPciIoEvent);
   if (EFI_ERROR (Status)) {
     goto ClosePciIoEvent;
   }
 
+  //
+  // Share the index with the other VfioIgdPkg drivers. They can do without.
+  //
+  Status = InstallFwCfgIndex (ImageHandle);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "%a: InstallFwCfgIndex: %r, ignoring\n", __FUNCTION__,
+      Status));
+  }
+  ReportFwCfgIndex ();
+
   return EFI_SUCCESS;
 
 ClosePciIoEvent:
-  gBS->CloseEvent (PciIoEvent);
+  gBS->CloseEvent (mPciIoEvent);
+
+FreeFwCfgIndex:
+  FreeFwCfgIndex ();
 
   return Status;
 }
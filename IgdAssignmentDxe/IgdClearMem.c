@@ -0,0 +1,305 @@
+/** @file
+
+  Clearing of large IGD reservations, such as stolen memory.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#include <PiDxe.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/MpService.h>
+
+#include "IgdClearMem.h"
+
+//
+// Granularity at which processors pick up work. Small enough to balance the
+// load between processors, large enough to keep the atomic counter cold.
+//
+#define CLEAR_CHUNK_SIZE  SIZE_2MB
+
+//
+// Ranges at least this large are cleared with streaming stores, which bypass
+// the caches instead of evicting everything else. Smaller ones use ZeroMem().
+//
+#define CLEAR_NT_THRESHOLD  SIZE_256KB
+#define CLEAR_NT_ALIGNMENT  64
+
+typedef
+VOID
+(EFIAPI *CLEAR_KERNEL) (
+  OUT VOID  *Buffer,
+  IN  UINTN Length
+  );
+
+#if defined (MDE_CPU_X64)
+//
+// Streaming store kernels in X64/ClearMemNt.nasm. Buffer must be aligned to
+// CLEAR_NT_ALIGNMENT, and Length must be a multiple of CLEAR_NT_ALIGNMENT.
+//
+VOID
+EFIAPI
+InternalClearMemNtSse2 (
+  OUT VOID  *Buffer,
+  IN  UINTN Length
+  );
+
+VOID
+EFIAPI
+InternalClearMemNtAvx (
+  OUT VOID  *Buffer,
+  IN  UINTN Length
+  );
+#endif
+
+//
+// Work description shared by all processors taking part in a clear.
+//
+typedef struct {
+  UINT8           *Base;
+  UINTN           Length;
+  UINT32          ChunkCount;
+  volatile UINT32 NextChunk;
+  //
+  // number of APs that are done with the job, and won't access it anymore
+  //
+  volatile UINT32 ApsDone;
+} CLEAR_JOB;
+
+/**
+  Select the streaming store kernel supported by the calling processor. This
+  is evaluated on every processor, because XCR0 is not necessarily the same on
+  the APs as on the BSP.
+
+  @return  The kernel to use, or NULL if none is available.
+**/
+STATIC
+CLEAR_KERNEL
+GetClearKernel (
+  VOID
+  )
+{
+#if defined (MDE_CPU_X64)
+  UINT32 Ecx;
+
+  //
+  // AVX requires CPUID.1:ECX.AVX, plus OS (that is, firmware) support for
+  // saving the YMM state, reported through CPUID.1:ECX.OSXSAVE and XCR0.
+  // SSE2 is architectural on X64.
+  //
+  AsmCpuid (1, NULL, NULL, &Ecx, NULL);
+  if ((Ecx & (BIT27 | BIT28)) == (BIT27 | BIT28) &&
+      (AsmXGetBv (0) & (BIT1 | BIT2)) == (BIT1 | BIT2)) {
+    return InternalClearMemNtAvx;
+  }
+  return InternalClearMemNtSse2;
+#else
+  return NULL;
+#endif
+}
+
+/**
+  Zero out a memory range, using Kernel for the aligned bulk of the range if
+  the range is large enough.
+
+  @param[in]  Kernel  Streaming store kernel from GetClearKernel(), or NULL.
+  @param[out] Buffer  Start of the range to zero.
+  @param[in]  Length  Size of the range in bytes.
+**/
+STATIC
+VOID
+ClearRange (
+  IN  CLEAR_KERNEL Kernel,
+  OUT UINT8        *Buffer,
+  IN  UINTN        Length
+  )
+{
+  UINTN Head;
+  UINTN Body;
+
+  if (Kernel == NULL || Length < CLEAR_NT_THRESHOLD) {
+    ZeroMem (Buffer, Length);
+    return;
+  }
+
+  Head = ALIGN_VALUE ((UINTN)Buffer, CLEAR_NT_ALIGNMENT) - (UINTN)Buffer;
+  Body = (Length - Head) & ~(UINTN)(CLEAR_NT_ALIGNMENT - 1);
+
+  ZeroMem (Buffer, Head);
+  Kernel (Buffer + Head, Body);
+  ZeroMem (Buffer + Head + Body, Length - Head - Body);
+}
+
+/**
+  Zero out chunks of a CLEAR_JOB until none are left. This function runs on
+  both the BSP and the APs, so it must not call any boot services, nor log.
+
+  @param[in,out] Buffer  The CLEAR_JOB to work on.
+**/
+STATIC
+VOID
+EFIAPI
+ClearWorker (
+  IN OUT VOID *Buffer
+  )
+{
+  CLEAR_JOB    *Job;
+  CLEAR_KERNEL Kernel;
+  UINT32       Chunk;
+  UINTN        Offset;
+
+  Job    = Buffer;
+  Kernel = GetClearKernel ();
+  for (;;) {
+    Chunk = InterlockedIncrement (&Job->NextChunk) - 1;
+    if (Chunk >= Job->ChunkCount) {
+      break;
+    }
+    Offset = (UINTN)Chunk * CLEAR_CHUNK_SIZE;
+    ClearRange (
+      Kernel,
+      Job->Base + Offset,
+      MIN (CLEAR_CHUNK_SIZE, Job->Length - Offset)
+      );
+  }
+}
+
+/**
+  Run ClearWorker() on an AP, and report when the AP is done with the job.
+
+  @param[in,out] Buffer  The CLEAR_JOB to work on.
+**/
+STATIC
+VOID
+EFIAPI
+ClearApWorker (
+  IN OUT VOID *Buffer
+  )
+{
+  CLEAR_JOB *Job;
+
+  Job = Buffer;
+  ClearWorker (Job);
+  InterlockedIncrement (&Job->ApsDone);
+}
+
+/**
+  Release the event passed to StartupAllAPs() once the MP services signal it.
+
+  @param[in] Event    The event.
+  @param[in] Context  Unused.
+**/
+STATIC
+VOID
+EFIAPI
+ClearApsSignaled (
+  IN EFI_EVENT Event,
+  IN VOID      *Context
+  )
+{
+  gBS->CloseEvent (Event);
+}
+
+/**
+  Zero out a large memory range, spreading the work over all enabled
+  processors when EFI_MP_SERVICES_PROTOCOL is available.
+
+  @param[out] Buffer  Start of the range to zero.
+  @param[in]  Length  Size of the range in bytes.
+**/
+VOID
+EFIAPI
+ClearLargeMemory (
+  OUT VOID  *Buffer,
+  IN  UINTN Length
+  )
+{
+  EFI_STATUS               Status;
+  EFI_MP_SERVICES_PROTOCOL *MpServices;
+  UINTN                    NumberOfProcessors;
+  UINTN                    NumberOfEnabledProcessors;
+  EFI_EVENT                ApsEvent;
+  UINT32                   ApsStarted;
+  CLEAR_JOB                Job;
+
+  Job.Base       = Buffer;
+  Job.Length     = Length;
+  Job.ChunkCount = (UINT32)((Length + (CLEAR_CHUNK_SIZE - 1)) / CLEAR_CHUNK_SIZE);
+  Job.NextChunk  = 0;
+  Job.ApsDone    = 0;
+  ApsStarted     = 0;
+  ApsEvent       = NULL;
+
+  if (Job.ChunkCount > 1) {
+    Status = gBS->LocateProtocol (
+                    &gEfiMpServiceProtocolGuid,
+                    NULL,                       // Registration
+                    (VOID **)&MpServices
+                    );
+    if (!EFI_ERROR (Status)) {
+      Status = MpServices->GetNumberOfProcessors (
+                             MpServices,
+                             &NumberOfProcessors,
+                             &NumberOfEnabledProcessors
+                             );
+    }
+    if (!EFI_ERROR (Status) && NumberOfEnabledProcessors > 1) {
+      Status = gBS->CreateEvent (
+                      EVT_NOTIFY_SIGNAL,
+                      TPL_CALLBACK,
+                      ClearApsSignaled,
+                      NULL,               // NotifyContext
+                      &ApsEvent
+                      );
+    }
+    if (!EFI_ERROR (Status) && NumberOfEnabledProcessors > 1) {
+      //
+      // Non-blocking mode, so that the BSP takes its share of the chunks
+      // while the APs run.
+      //
+      Status = MpServices->StartupAllAPs (
+                             MpServices,
+                             ClearApWorker,
+                             FALSE,         // SingleThread
+                             ApsEvent,
+                             0,             // TimeoutInMicroSeconds
+                             &Job,
+                             NULL           // FailedCpuList
+                             );
+      if (EFI_ERROR (Status)) {
+        gBS->CloseEvent (ApsEvent);
+      } else {
+        ApsStarted = (UINT32)(NumberOfEnabledProcessors - 1);
+      }
+      DEBUG ((DEBUG_VERBOSE, "%a: %Lu chunks on %Lu APs: %r\n", __FUNCTION__,
+        (UINT64)Job.ChunkCount, (UINT64)(NumberOfEnabledProcessors - 1),
+        Status));
+    }
+  }
+
+  //
+  // Let the BSP clear chunks alongside the APs, which is all of them if the
+  // APs could not be started.
+  //
+  ClearWorker (&Job);
+
+  //
+  // The MP services notice that the APs are done only from a periodic timer,
+  // so wait for the APs themselves rather than for ApsEvent: the range is
+  // clear, and Job is no longer accessed, once every AP has reported. The
+  // event releases itself when it is signaled.
+  //
+  while (Job.ApsDone < ApsStarted) {
+    CpuPause ();
+  }
+}
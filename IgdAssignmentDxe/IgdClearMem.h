@@ -0,0 +1,33 @@
+/** @file
+
+  Internal function declarations for clearing large IGD reservations.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _IGD_CLEAR_MEM_H_
+#define _IGD_CLEAR_MEM_H_
+
+#include <Uefi.h>
+
+/**
+  Zero out a large memory range, spreading the work over all enabled
+  processors when EFI_MP_SERVICES_PROTOCOL is available.
+
+  @param[out] Buffer  Start of the range to zero.
+  @param[in]  Length  Size of the range in bytes.
+**/
+VOID
+EFIAPI
+ClearLargeMemory (
+  OUT VOID  *Buffer,
+  IN  UINTN Length
+  );
+
+#endif
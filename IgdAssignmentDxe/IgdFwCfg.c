@@ -0,0 +1,381 @@
+/** @file
+
+  Cached fw_cfg file directory. QemuFwCfgFindFile() walks the whole directory
+  through the fw_cfg data port on every call, and on the I/O port interface
+  each byte read is a separate exit to the host. The directory is read once
+  here instead, and lookups are served from memory, both to this driver and,
+  through IGD_FW_CFG_INDEX_PROTOCOL, to the other VfioIgdPkg drivers.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/QemuFwCfgLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/IgdFwCfgIndex.h>
+
+#include "IgdFwCfg.h"
+
+//
+// entry of the fw_cfg file directory, QemuFwCfgItemFileDir
+//
+#pragma pack (1)
+typedef struct {
+  UINT32 Size;      // big endian
+  UINT16 Select;    // big endian
+  UINT16 Reserved;
+  CHAR8  Name[QEMU_FW_CFG_FNAME_SIZE];
+} FW_CFG_DIR_ENTRY;
+#pragma pack ()
+
+typedef struct {
+  CHAR8                Name[QEMU_FW_CFG_FNAME_SIZE];
+  FIRMWARE_CONFIG_ITEM Item;
+  UINTN                Size;
+} FW_CFG_INDEX_ENTRY;
+
+//
+// Largest knob contents that are parsed, including a trailing newline; enough
+// for any boolean or 32-bit decimal value.
+//
+#define FW_CFG_KNOB_SIZE_MAX  32
+
+//
+// Spellings of boolean knobs, as accepted by QemuFwCfgSimpleParserLib
+//
+STATIC CONST CHAR8 *CONST mTrueStrings[] = {
+  "true", "yes", "y", "enable", "1"
+};
+STATIC CONST CHAR8 *CONST mFalseStrings[] = {
+  "false", "no", "n", "disable", "0"
+};
+
+STATIC FW_CFG_INDEX_ENTRY *mIndex;
+STATIC UINT32             mIndexCount;
+STATIC BOOLEAN            mIndexInstalled;
+
+//
+// number of lookups served from the index, each of which would have walked
+// the directory otherwise
+//
+STATIC UINT64             mIndexLookups;
+
+
+STATIC
+EFI_STATUS
+EFIAPI
+IndexFindFile (
+  IN  IGD_FW_CFG_INDEX_PROTOCOL *This,
+  IN  CONST CHAR8               *Name,
+  OUT FIRMWARE_CONFIG_ITEM      *Item,
+  OUT UINTN                     *Size
+  )
+{
+  return IgdFwCfgFindFile (Name, Item, Size);
+}
+
+STATIC IGD_FW_CFG_INDEX_PROTOCOL mIndexProtocol = {
+  IGD_FW_CFG_INDEX_PROTOCOL_REVISION,
+  IndexFindFile
+};
+
+
+/**
+  Read the fw_cfg file directory into an index. This is the only walk of the
+  directory; all later lookups are served from memory.
+
+  @retval EFI_SUCCESS           The index has been built.
+  @retval EFI_UNSUPPORTED       fw_cfg is not available.
+  @retval EFI_OUT_OF_RESOURCES  The index could not be allocated.
+**/
+EFI_STATUS
+EFIAPI
+InitFwCfgIndex (
+  VOID
+  )
+{
+  EFI_STATUS       Status;
+  UINT32           Count;
+  UINT32           Index;
+  FW_CFG_DIR_ENTRY Entry;
+
+  if (!QemuFwCfgIsAvailable ()) {
+    return EFI_UNSUPPORTED;
+  }
+
+  QemuFwCfgSelectItem (QemuFwCfgItemFileDir);
+  QemuFwCfgReadBytes (sizeof Count, &Count);
+  Count = SwapBytes32 (Count);
+
+  Status = gBS->AllocatePool (
+                  EfiBootServicesData,
+                  MAX (Count, 1) * sizeof (FW_CFG_INDEX_ENTRY),
+                  (VOID **)&mIndex
+                  );
+  if (EFI_ERROR (Status)) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    QemuFwCfgReadBytes (sizeof Entry, &Entry);
+    CopyMem (mIndex[Index].Name, Entry.Name, sizeof Entry.Name);
+    mIndex[Index].Name[QEMU_FW_CFG_FNAME_SIZE - 1] = '\0';
+    mIndex[Index].Item = (FIRMWARE_CONFIG_ITEM)SwapBytes16 (Entry.Select);
+    mIndex[Index].Size = SwapBytes32 (Entry.Size);
+  }
+  mIndexCount = Count;
+
+  DEBUG ((DEBUG_INFO, "%a: %u files, %Lu bytes of directory\n", __FUNCTION__,
+    mIndexCount, (UINT64)(sizeof Count + Count * sizeof Entry)));
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Release the index, unless it has been published with InstallFwCfgIndex().
+**/
+VOID
+EFIAPI
+FreeFwCfgIndex (
+  VOID
+  )
+{
+  if (mIndex == NULL || mIndexInstalled) {
+    return;
+  }
+  gBS->FreePool (mIndex);
+  mIndex = NULL;
+  mIndexCount = 0;
+}
+
+
+/**
+  Publish the index to other drivers through IGD_FW_CFG_INDEX_PROTOCOL.
+
+  @param[in] Handle  The handle to install the protocol on.
+
+  @return  Status codes from gBS->InstallProtocolInterface().
+**/
+EFI_STATUS
+EFIAPI
+InstallFwCfgIndex (
+  IN EFI_HANDLE Handle
+  )
+{
+  EFI_STATUS Status;
+
+  Status = gBS->InstallProtocolInterface (
+                  &Handle,
+                  &gIgdFwCfgIndexProtocolGuid,
+                  EFI_NATIVE_INTERFACE,
+                  &mIndexProtocol
+                  );
+  if (!EFI_ERROR (Status)) {
+    mIndexInstalled = TRUE;
+  }
+  return Status;
+}
+
+
+/**
+  Find the named fw_cfg file in the index.
+
+  @param[in]  Name  Name of the fw_cfg file.
+  @param[out] Item  The fw_cfg selector of the file.
+  @param[out] Size  The size of the file.
+
+  @retval EFI_SUCCESS    The file has been found.
+  @retval EFI_NOT_FOUND  There is no such file.
+**/
+EFI_STATUS
+EFIAPI
+IgdFwCfgFindFile (
+  IN  CONST CHAR8          *Name,
+  OUT FIRMWARE_CONFIG_ITEM *Item,
+  OUT UINTN                *Size
+  )
+{
+  UINT32 Index;
+
+  mIndexLookups++;
+  for (Index = 0; Index < mIndexCount; Index++) {
+    if (AsciiStrCmp (mIndex[Index].Name, Name) == 0) {
+      *Item = mIndex[Index].Item;
+      *Size = mIndex[Index].Size;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_NOT_FOUND;
+}
+
+
+/**
+  Count the fw_cfg files whose names start with Prefix.
+
+  @param[in] Prefix  The name prefix.
+
+  @return  The number of matching files.
+**/
+UINTN
+EFIAPI
+IgdFwCfgCountFiles (
+  IN CONST CHAR8 *Prefix
+  )
+{
+  UINT32 Index;
+  UINTN  PrefixLength;
+  UINTN  Count;
+
+  mIndexLookups++;
+  PrefixLength = AsciiStrLen (Prefix);
+  Count = 0;
+  for (Index = 0; Index < mIndexCount; Index++) {
+    if (AsciiStrnCmp (mIndex[Index].Name, Prefix, PrefixLength) == 0) {
+      Count++;
+    }
+  }
+  return Count;
+}
+
+
+/**
+  Read a small fw_cfg file found in the index as a string, without its
+  trailing newline, if any.
+
+  @param[in]  Name    Name of the fw_cfg file.
+  @param[out] String  The contents of the file, NUL-terminated.
+
+  @retval EFI_SUCCESS         The file has been read.
+  @retval EFI_NOT_FOUND       There is no such file.
+  @retval EFI_PROTOCOL_ERROR  The file is too large for String.
+**/
+STATIC
+EFI_STATUS
+ReadKnob (
+  IN  CONST CHAR8 *Name,
+  OUT CHAR8       String[FW_CFG_KNOB_SIZE_MAX + 1]
+  )
+{
+  EFI_STATUS           Status;
+  FIRMWARE_CONFIG_ITEM Item;
+  UINTN                Size;
+
+  Status = IgdFwCfgFindFile (Name, &Item, &Size);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Size > FW_CFG_KNOB_SIZE_MAX) {
+    return EFI_PROTOCOL_ERROR;
+  }
+  QemuFwCfgSelectItem (Item);
+  QemuFwCfgReadBytes (Size, String);
+  if (Size > 0 && String[Size - 1] == '\n') {
+    Size--;
+  }
+  String[Size] = '\0';
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Parse a boolean fw_cfg knob found in the index, like QemuFwCfgParseBool(),
+  but without walking the fw_cfg directory.
+
+  @param[in]  Name   Name of the fw_cfg file.
+  @param[out] Value  The value of the knob.
+
+  @retval EFI_SUCCESS         The knob has been parsed.
+  @retval EFI_NOT_FOUND       There is no such file.
+  @retval EFI_PROTOCOL_ERROR  The contents of the file are not a boolean.
+**/
+EFI_STATUS
+EFIAPI
+IgdFwCfgParseBool (
+  IN  CONST CHAR8 *Name,
+  OUT BOOLEAN     *Value
+  )
+{
+  EFI_STATUS Status;
+  CHAR8      String[FW_CFG_KNOB_SIZE_MAX + 1];
+  UINTN      Index;
+
+  Status = ReadKnob (Name, String);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  for (Index = 0; Index < ARRAY_SIZE (mTrueStrings); Index++) {
+    if (AsciiStriCmp (String, mTrueStrings[Index]) == 0) {
+      *Value = TRUE;
+      return EFI_SUCCESS;
+    }
+    if (AsciiStriCmp (String, mFalseStrings[Index]) == 0) {
+      *Value = FALSE;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_PROTOCOL_ERROR;
+}
+
+
+/**
+  Parse a decimal 32-bit fw_cfg knob found in the index, like
+  QemuFwCfgParseUint32() with ParseAsHex=FALSE, but without walking the fw_cfg
+  directory.
+
+  @param[in]  Name   Name of the fw_cfg file.
+  @param[out] Value  The value of the knob.
+
+  @retval EFI_SUCCESS         The knob has been parsed.
+  @retval EFI_NOT_FOUND       There is no such file.
+  @retval EFI_PROTOCOL_ERROR  The contents of the file are not a decimal
+                              32-bit value.
+**/
+EFI_STATUS
+EFIAPI
+IgdFwCfgParseUint32 (
+  IN  CONST CHAR8 *Name,
+  OUT UINT32      *Value
+  )
+{
+  EFI_STATUS Status;
+  CHAR8      String[FW_CFG_KNOB_SIZE_MAX + 1];
+  CHAR8      *End;
+  UINTN      Number;
+
+  Status = ReadKnob (Name, String);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (String[0] < '0' || String[0] > '9') {
+    return EFI_PROTOCOL_ERROR;
+  }
+  Status = AsciiStrDecimalToUintnS (String, &End, &Number);
+  if (EFI_ERROR (Status) || *End != '\0' || Number > MAX_UINT32) {
+    return EFI_PROTOCOL_ERROR;
+  }
+  *Value = (UINT32)Number;
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Log how many directory walks the index has saved.
+**/
+VOID
+EFIAPI
+ReportFwCfgIndex (
+  VOID
+  )
+{
+  DEBUG ((DEBUG_INFO, "%a: 1 directory walk instead of %Lu, each reading up to "
+    "%Lu bytes\n", __FUNCTION__, mIndexLookups,
+    (UINT64)(sizeof (UINT32) + mIndexCount * sizeof (FW_CFG_DIR_ENTRY))));
+}
@@ -0,0 +1,134 @@
+/** @file
+
+  Internal function declarations for the cached fw_cfg file directory.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _IGD_FW_CFG_H_
+#define _IGD_FW_CFG_H_
+
+#include <Uefi.h>
+#include <Library/QemuFwCfgLib.h>
+
+/**
+  Read the fw_cfg file directory into an index. This is the only walk of the
+  directory; all later lookups are served from memory.
+
+  @retval EFI_SUCCESS           The index has been built.
+  @retval EFI_UNSUPPORTED       fw_cfg is not available.
+  @retval EFI_OUT_OF_RESOURCES  The index could not be allocated.
+**/
+EFI_STATUS
+EFIAPI
+InitFwCfgIndex (
+  VOID
+  );
+
+/**
+  Release the index, unless it has been published with InstallFwCfgIndex().
+**/
+VOID
+EFIAPI
+FreeFwCfgIndex (
+  VOID
+  );
+
+/**
+  Publish the index to other drivers through IGD_FW_CFG_INDEX_PROTOCOL.
+
+  @param[in] Handle  The handle to install the protocol on.
+
+  @return  Status codes from gBS->InstallProtocolInterface().
+**/
+EFI_STATUS
+EFIAPI
+InstallFwCfgIndex (
+  IN EFI_HANDLE Handle
+  );
+
+/**
+  Find the named fw_cfg file in the index.
+
+  @param[in]  Name  Name of the fw_cfg file.
+  @param[out] Item  The fw_cfg selector of the file.
+  @param[out] Size  The size of the file.
+
+  @retval EFI_SUCCESS    The file has been found.
+  @retval EFI_NOT_FOUND  There is no such file.
+**/
+EFI_STATUS
+EFIAPI
+IgdFwCfgFindFile (
+  IN  CONST CHAR8          *Name,
+  OUT FIRMWARE_CONFIG_ITEM *Item,
+  OUT UINTN                *Size
+  );
+
+/**
+  Count the fw_cfg files whose names start with Prefix.
+
+  @param[in] Prefix  The name prefix.
+
+  @return  The number of matching files.
+**/
+UINTN
+EFIAPI
+IgdFwCfgCountFiles (
+  IN CONST CHAR8 *Prefix
+  );
+
+/**
+  Parse a boolean fw_cfg knob found in the index, like QemuFwCfgParseBool(),
+  but without walking the fw_cfg directory.
+
+  @param[in]  Name   Name of the fw_cfg file.
+  @param[out] Value  The value of the knob.
+
+  @retval EFI_SUCCESS         The knob has been parsed.
+  @retval EFI_NOT_FOUND       There is no such file.
+  @retval EFI_PROTOCOL_ERROR  The contents of the file are not a boolean.
+**/
+EFI_STATUS
+EFIAPI
+IgdFwCfgParseBool (
+  IN  CONST CHAR8 *Name,
+  OUT BOOLEAN     *Value
+  );
+
+/**
+  Parse a decimal 32-bit fw_cfg knob found in the index, like
+  QemuFwCfgParseUint32() with ParseAsHex=FALSE, but without walking the fw_cfg
+  directory.
+
+  @param[in]  Name   Name of the fw_cfg file.
+  @param[out] Value  The value of the knob.
+
+  @retval EFI_SUCCESS         The knob has been parsed.
+  @retval EFI_NOT_FOUND       There is no such file.
+  @retval EFI_PROTOCOL_ERROR  The contents of the file are not a decimal
+                              32-bit value.
+**/
+EFI_STATUS
+EFIAPI
+IgdFwCfgParseUint32 (
+  IN  CONST CHAR8 *Name,
+  OUT UINT32      *Value
+  );
+
+/**
+  Log how many directory walks the index has saved.
+**/
+VOID
+EFIAPI
+ReportFwCfgIndex (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,264 @@
+/** @file
+
+  NUMA-aware placement of IGD reservations. The proximity domain is requested
+  by the host, and its memory ranges are taken from the SRAT that QEMU passes
+  in the "etc/acpi/tables" fw_cfg file. The ACPI tables are not installed yet
+  when PCI enumeration loads this driver, hence the fw_cfg file.
+
+  QEMU builds the ACPI tables on the first read of that file, and doesn't
+  update them afterwards. The file must therefore not be read before PCI
+  resources have been assigned, or the tables that AcpiPlatformDxe installs
+  later would describe stale resources. It is only read when the first
+  reservation is placed, from the PciIo notification, which runs after
+  resource assignment.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#include <IndustryStandard/Acpi.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/QemuFwCfgLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+#include <IndustryStandard/AssignedIgd.h>
+
+#include "IgdFwCfg.h"
+#include "IgdNuma.h"
+
+#define ACPI_TABLES_FW_CFG_FILE  "etc/acpi/tables"
+
+#define MAX_NUMA_RANGES  16
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS Base;
+  EFI_PHYSICAL_ADDRESS Limit;
+} NUMA_RANGE;
+
+//
+// memory ranges of the requested proximity domain, in descending order
+//
+STATIC NUMA_RANGE mNumaRanges[MAX_NUMA_RANGES];
+STATIC UINTN      mNumaRangeCount;
+
+//
+// proximity domain requested by the host, valid if mNumaRequested is set, and
+// whether its ranges have been looked up in the SRAT
+//
+STATIC UINT32     mNumaDomain;
+STATIC BOOLEAN    mNumaRequested;
+STATIC BOOLEAN    mNumaRangesLoaded;
+
+/**
+  Record a memory range of the requested proximity domain, keeping
+  mNumaRanges sorted in descending order of address.
+
+  @param[in] Base   Base address of the range.
+  @param[in] Limit  Highest address of the range.
+**/
+STATIC
+VOID
+AddNumaRange (
+  IN EFI_PHYSICAL_ADDRESS Base,
+  IN EFI_PHYSICAL_ADDRESS Limit
+  )
+{
+  UINTN Index;
+
+  if (mNumaRangeCount == MAX_NUMA_RANGES) {
+    DEBUG ((DEBUG_WARN, "%a: too many ranges, ignoring 0x%Lx-0x%Lx\n",
+      __FUNCTION__, Base, Limit));
+    return;
+  }
+
+  for (Index = mNumaRangeCount;
+       Index > 0 && mNumaRanges[Index - 1].Base < Base;
+       Index--) {
+    mNumaRanges[Index] = mNumaRanges[Index - 1];
+  }
+  mNumaRanges[Index].Base  = Base;
+  mNumaRanges[Index].Limit = Limit;
+  mNumaRangeCount++;
+}
+
+/**
+  Collect the enabled, present memory ranges of a proximity domain from an
+  SRAT.
+
+  @param[in] Srat    The SRAT, whose length has been validated.
+  @param[in] Domain  The proximity domain.
+**/
+STATIC
+VOID
+ParseSrat (
+  IN CONST EFI_ACPI_DESCRIPTION_HEADER *Srat,
+  IN UINT32                            Domain
+  )
+{
+  CONST UINT8                                    *Entry;
+  CONST UINT8                                    *End;
+  CONST EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE   *Memory;
+  EFI_PHYSICAL_ADDRESS                           Base;
+  UINT64                                         Length;
+
+  Entry = (CONST UINT8 *)Srat +
+          sizeof (EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER);
+  End   = (CONST UINT8 *)Srat + Srat->Length;
+
+  //
+  // Every affinity structure starts with Type and Length bytes.
+  //
+  while (End - Entry >= 2 && Entry[1] >= 2 && End - Entry >= Entry[1]) {
+    if (Entry[0] == EFI_ACPI_3_0_MEMORY_AFFINITY &&
+        Entry[1] >= sizeof *Memory) {
+      Memory = (CONST EFI_ACPI_3_0_MEMORY_AFFINITY_STRUCTURE *)Entry;
+      Base   = LShiftU64 (Memory->AddressBaseHigh, 32) | Memory->AddressBaseLow;
+      Length = LShiftU64 (Memory->LengthHigh, 32) | Memory->LengthLow;
+
+      //
+      // Hot-pluggable ranges are not populated at boot.
+      //
+      if (Memory->ProximityDomain == Domain &&
+          Length > 0 &&
+          (Memory->Flags & EFI_ACPI_3_0_MEMORY_ENABLED) != 0 &&
+          (Memory->Flags & EFI_ACPI_3_0_MEMORY_HOT_PLUGGABLE) == 0) {
+        AddNumaRange (Base, Base + Length - 1);
+      }
+    }
+    Entry += Entry[1];
+  }
+}
+
+/**
+  Read the memory ranges of the requested proximity domain from the SRAT.
+
+  @retval EFI_SUCCESS    The ranges of the requested node are known.
+  @retval EFI_NOT_FOUND  The SRAT describes no memory for the requested node.
+  @return                Error codes from reading the SRAT.
+**/
+STATIC
+EFI_STATUS
+LoadNumaRanges (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  FIRMWARE_CONFIG_ITEM        TablesItem;
+  UINTN                       TablesSize;
+  UINT8                       *Tables;
+  UINTN                       Offset;
+  EFI_ACPI_DESCRIPTION_HEADER *Header;
+  UINTN                       Index;
+
+  Status = IgdFwCfgFindFile (ACPI_TABLES_FW_CFG_FILE, &TablesItem,
+             &TablesSize);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: %a: %r\n", __FUNCTION__, ACPI_TABLES_FW_CFG_FILE,
+      Status));
+    return Status;
+  }
+  Status = gBS->AllocatePool (EfiBootServicesData, TablesSize,
+                  (VOID **)&Tables);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  QemuFwCfgSelectItem (TablesItem);
+  QemuFwCfgReadBytes (TablesSize, Tables);
+
+  //
+  // The blob is a concatenation of ACPI tables, whose pointers are yet to be
+  // patched by the linker/loader script. The SRAT contains no pointers, so
+  // look for a header with the right signature, a sane length and a valid
+  // checksum.
+  //
+  for (Offset = 0;
+       TablesSize - Offset >= sizeof (EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER);
+       Offset++) {
+    Header = (EFI_ACPI_DESCRIPTION_HEADER *)(Tables + Offset);
+    if (Header->Signature != EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_SIGNATURE ||
+        Header->Length < sizeof (EFI_ACPI_3_0_SYSTEM_RESOURCE_AFFINITY_TABLE_HEADER) ||
+        Header->Length > TablesSize - Offset ||
+        CalculateSum8 ((UINT8 *)Header, Header->Length) != 0) {
+      continue;
+    }
+    ParseSrat (Header, mNumaDomain);
+    break;
+  }
+  gBS->FreePool (Tables);
+
+  if (mNumaRangeCount == 0) {
+    DEBUG ((DEBUG_WARN, "%a: no memory found for node %u\n", __FUNCTION__,
+      mNumaDomain));
+    return EFI_NOT_FOUND;
+  }
+
+  for (Index = 0; Index < mNumaRangeCount; Index++) {
+    DEBUG ((DEBUG_INFO, "%a: node %u: 0x%Lx-0x%Lx\n", __FUNCTION__,
+      mNumaDomain, mNumaRanges[Index].Base, mNumaRanges[Index].Limit));
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Determine the proximity domain that IGD reservations should be placed in, if
+  the host requested one with ASSIGNED_IGD_FW_CFG_NUMA_NODE. Its memory ranges
+  are only looked up when the first reservation is placed.
+
+  @retval EFI_SUCCESS    A node has been requested.
+  @retval EFI_NOT_FOUND  No node has been requested.
+  @return                Error codes from parsing the knob.
+**/
+EFI_STATUS
+EFIAPI
+InitNumaPlacement (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+
+  Status = IgdFwCfgParseUint32 (ASSIGNED_IGD_FW_CFG_NUMA_NODE, &mNumaDomain);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  DEBUG ((DEBUG_INFO, "%a: node %u requested\n", __FUNCTION__, mNumaDomain));
+  mNumaRequested = TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Get a memory range of the requested proximity domain. The ranges are read
+  from the SRAT on the first call.
+
+  @param[in]  Index       Index of the range, starting at zero. Ranges are
+                          returned in descending order of address.
+  @param[out] Base        Base address of the range.
+  @param[out] Limit       Highest address of the range.
+
+  @retval TRUE   The range has been returned.
+  @retval FALSE  Index is past the last range, or no node has been requested.
+**/
+BOOLEAN
+EFIAPI
+GetNumaRange (
+  IN  UINTN                Index,
+  OUT EFI_PHYSICAL_ADDRESS *Base,
+  OUT EFI_PHYSICAL_ADDRESS *Limit
+  )
+{
+  if (mNumaRequested && !mNumaRangesLoaded) {
+    mNumaRangesLoaded = TRUE;
+    LoadNumaRanges ();
+  }
+  if (Index >= mNumaRangeCount) {
+    return FALSE;
+  }
+  *Base  = mNumaRanges[Index].Base;
+  *Limit = mNumaRanges[Index].Limit;
+  return TRUE;
+}
@@ -0,0 +1,54 @@
+/** @file
+
+  Internal function declarations for NUMA-aware placement of IGD reservations.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _IGD_NUMA_H_
+#define _IGD_NUMA_H_
+
+#include <Uefi.h>
+
+/**
+  Determine the proximity domain that IGD reservations should be placed in, if
+  the host requested one with ASSIGNED_IGD_FW_CFG_NUMA_NODE. Its memory ranges
+  are only looked up when the first reservation is placed.
+
+  @retval EFI_SUCCESS    A node has been requested.
+  @retval EFI_NOT_FOUND  No node has been requested.
+  @return                Error codes from parsing the knob.
+**/
+EFI_STATUS
+EFIAPI
+InitNumaPlacement (
+  VOID
+  );
+
+/**
+  Get a memory range of the requested proximity domain. The ranges are read
+  from the SRAT on the first call.
+
+  @param[in]  Index       Index of the range, starting at zero. Ranges are
+                          returned in descending order of address.
+  @param[out] Base        Base address of the range.
+  @param[out] Limit       Highest address of the range.
+
+  @retval TRUE   The range has been returned.
+  @retval FALSE  Index is past the last range, or no node has been requested.
+**/
+BOOLEAN
+EFIAPI
+GetNumaRange (
+  IN  UINTN                Index,
+  OUT EFI_PHYSICAL_ADDRESS *Base,
+  OUT EFI_PHYSICAL_ADDRESS *Limit
+  );
+
+#endif
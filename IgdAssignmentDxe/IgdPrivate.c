@@ -16,24 +16,102 @@
 #include <Library/DebugLib.h>
 
 #include "IgdPrivate.h"
-#include "IgdPciIds.h"
 
+//
+// The device table has hundreds of entries, so keep them small: a device ID and
+// an index into IgdPrivateTable, 3 bytes rather than 16 with a pointer.
+//
+#pragma pack (1)
 typedef struct {
-  UINT16                  DeviceId;
-  CONST IGD_PRIVATE_DATA  *Private;
+  UINT16  DeviceId;
+  UINT8   Generation;
 } IGD_DEVICE_INFO;
+#pragma pack ()
 
-#define IGD_DEVICE(Id, Priv) { \
+#define IGD_DEVICE(Id, Gen) { \
   .DeviceId = Id, \
-  .Private = Priv \
+  .Generation = Gen \
 }
 
+//
+// The DSC passes -DIGD_BUILD_<IGD_GEN> to build a ROM for a single generation,
+// leaving out the other generations' table rows and stolen memory decoders.
+// Builds that don't select a generation support all of them.
+//
+#if !defined (IGD_BUILD_GEN6) && !defined (IGD_BUILD_GEN8) && \
+    !defined (IGD_BUILD_CHV) && !defined (IGD_BUILD_GEN9) && \
+    !defined (IGD_BUILD_GEN11) && !defined (IGD_BUILD_XE)
+#define IGD_BUILD_ALL
+#endif
+
+#if defined (IGD_BUILD_ALL) || defined (IGD_BUILD_GEN6)
+#define IGD_HAS_GEN6    1
+#else
+#define IGD_HAS_GEN6    0
+#endif
+
+#if defined (IGD_BUILD_ALL) || defined (IGD_BUILD_GEN8)
+#define IGD_HAS_GEN8    1
+#else
+#define IGD_HAS_GEN8    0
+#endif
+
+#if defined (IGD_BUILD_ALL) || defined (IGD_BUILD_CHV)
+#define IGD_HAS_CHV     1
+#else
+#define IGD_HAS_CHV     0
+#endif
+
+#if defined (IGD_BUILD_ALL) || defined (IGD_BUILD_GEN9)
+#define IGD_HAS_GEN9    1
+#else
+#define IGD_HAS_GEN9    0
+#endif
+
+#if defined (IGD_BUILD_ALL) || defined (IGD_BUILD_GEN11)
+#define IGD_HAS_GEN11   1
+#else
+#define IGD_HAS_GEN11   0
+#endif
+
+#if defined (IGD_BUILD_ALL) || defined (IGD_BUILD_XE)
+#define IGD_HAS_XE      1
+#else
+#define IGD_HAS_XE      0
+#endif
+
+//
+// Indices into IgdPrivateTable
+//
+enum {
+#if IGD_HAS_GEN6
+  IGD_GEN6,
+#endif
+#if IGD_HAS_GEN8
+  IGD_GEN8,
+#endif
+#if IGD_HAS_CHV
+  IGD_CHV,
+#endif
+#if IGD_HAS_GEN9
+  IGD_GEN9,
+#endif
+#if IGD_HAS_GEN11
+  IGD_GEN11,
+#endif
+#if IGD_HAS_XE
+  IGD_NULL,
+#endif
+  IGD_GEN_COUNT
+};
+
 #define SNB_GMCH_CTRL           0x50
 #define    SNB_GMCH_GMS_SHIFT   3 /* Graphics Mode Select */
 #define    SNB_GMCH_GMS_MASK    0x1f
 #define    BDW_GMCH_GMS_SHIFT   8
 #define    BDW_GMCH_GMS_MASK    0xff
 
+#if IGD_HAS_GEN6
 STATIC
 UINTN
 Gen6StolenSize (
@@ -48,7 +126,9 @@ Gen6StolenSize (
 
   return Gms * SIZE_32MB;
 }
+#endif
 
+#if IGD_HAS_GEN8
 STATIC
 UINTN
 Gen8StolenSize (
@@ -63,7 +143,9 @@ Gen8StolenSize (
 
   return Gms * SIZE_32MB;
 }
+#endif
 
+#if IGD_HAS_CHV
 STATIC
 UINTN
 ChvStolenSize (
@@ -89,7 +171,9 @@ ChvStolenSize (
     return (Gms - 0x17) * SIZE_4MB + SIZE_4MB + SIZE_32MB;
   }   
 }
+#endif
 
+#if IGD_HAS_GEN9 || IGD_HAS_GEN11
 STATIC
 UINTN
 Gen9StolenSize (
@@ -110,70 +194,464 @@ Gen9StolenSize (
     return (Gms - 0xf0) * SIZE_4MB + SIZE_4MB;
   }
 }
-
-STATIC CONST IGD_PRIVATE_DATA Gen6Private = {
-  .Flags = IGD_FLAG_BDSM_32BIT,
-  .GetStolenSize = Gen6StolenSize,
+#endif
+
+STATIC CONST IGD_PRIVATE_DATA IgdPrivateTable[] = {
+#if IGD_HAS_GEN6
+  { // IGD_GEN6
+    .Flags = IGD_FLAG_BDSM_32BIT,
+    .GetStolenSize = Gen6StolenSize,
+  },
+#endif
+#if IGD_HAS_GEN8
+  { // IGD_GEN8
+    .Flags = IGD_FLAG_BDSM_32BIT,
+    .GetStolenSize = Gen8StolenSize,
+  },
+#endif
+#if IGD_HAS_CHV
+  { // IGD_CHV
+    .Flags = IGD_FLAG_BDSM_32BIT,
+    .GetStolenSize = ChvStolenSize,
+  },
+#endif
+#if IGD_HAS_GEN9
+  { // IGD_GEN9
+    .Flags = IGD_FLAG_BDSM_32BIT,
+    .GetStolenSize = Gen9StolenSize,
+  },
+#endif
+#if IGD_HAS_GEN11
+  { // IGD_GEN11
+    .Flags = IGD_FLAG_BDSM_64BIT,
+    .GetStolenSize = Gen9StolenSize,
+  },
+#endif
+#if IGD_HAS_XE
+  { // IGD_NULL
+    .Flags = 0,
+    .GetStolenSize = NULL,
+  },
+#endif
 };
 
-STATIC CONST IGD_PRIVATE_DATA Gen8Private = {
-  .Flags = IGD_FLAG_BDSM_32BIT,
-  .GetStolenSize = Gen8StolenSize,
-};
-
-STATIC CONST IGD_PRIVATE_DATA ChvPrivate = {
-  .Flags = IGD_FLAG_BDSM_32BIT,
-  .GetStolenSize = ChvStolenSize,
+STATIC_ASSERT (ARRAY_SIZE (IgdPrivateTable) == IGD_GEN_COUNT,
+  "IgdPrivateTable is out of sync with its indices");
+
+//
+// One macro per generation emits a table row in builds that include the
+// generation, and nothing in the others.
+//
+#if IGD_HAS_GEN6
+#define IGD_GEN6_DEVICE(Id)   IGD_DEVICE (Id, IGD_GEN6),
+#else
+#define IGD_GEN6_DEVICE(Id)
+#endif
+
+#if IGD_HAS_GEN8
+#define IGD_GEN8_DEVICE(Id)   IGD_DEVICE (Id, IGD_GEN8),
+#else
+#define IGD_GEN8_DEVICE(Id)
+#endif
+
+#if IGD_HAS_CHV
+#define IGD_CHV_DEVICE(Id)    IGD_DEVICE (Id, IGD_CHV),
+#else
+#define IGD_CHV_DEVICE(Id)
+#endif
+
+#if IGD_HAS_GEN9
+#define IGD_GEN9_DEVICE(Id)   IGD_DEVICE (Id, IGD_GEN9),
+#else
+#define IGD_GEN9_DEVICE(Id)
+#endif
+
+#if IGD_HAS_GEN11
+#define IGD_GEN11_DEVICE(Id)  IGD_DEVICE (Id, IGD_GEN11),
+#else
+#define IGD_GEN11_DEVICE(Id)
+#endif
+
+#if IGD_HAS_XE
+#define IGD_XE_DEVICE(Id)     IGD_DEVICE (Id, IGD_NULL),
+#else
+#define IGD_XE_DEVICE(Id)
+#endif
+
+//
+// Supported devices, from the INTEL_*_IDS lists in IgdPciIds.h, sorted by
+// device ID for binary search. Keep the table sorted when adding devices; each
+// device ID must appear once.
+//
+STATIC CONST IGD_DEVICE_INFO IgdDeviceTable[] = {
+  IGD_GEN6_DEVICE (0x0102)   // SNB
+  IGD_GEN6_DEVICE (0x0106)   // SNB
+  IGD_GEN6_DEVICE (0x010a)   // SNB
+  IGD_GEN6_DEVICE (0x0112)   // SNB
+  IGD_GEN6_DEVICE (0x0116)   // SNB
+  IGD_GEN6_DEVICE (0x0122)   // SNB
+  IGD_GEN6_DEVICE (0x0126)   // SNB
+  IGD_GEN6_DEVICE (0x0152)   // IVB
+  IGD_GEN6_DEVICE (0x0156)   // IVB
+  IGD_GEN6_DEVICE (0x015a)   // IVB
+  IGD_GEN6_DEVICE (0x0162)   // IVB
+  IGD_GEN6_DEVICE (0x0166)   // IVB
+  IGD_GEN6_DEVICE (0x016a)   // IVB
+  IGD_GEN6_DEVICE (0x0402)   // HSW
+  IGD_GEN6_DEVICE (0x0406)   // HSW
+  IGD_GEN6_DEVICE (0x040a)   // HSW
+  IGD_GEN6_DEVICE (0x040b)   // HSW
+  IGD_GEN6_DEVICE (0x040e)   // HSW
+  IGD_GEN6_DEVICE (0x0412)   // HSW
+  IGD_GEN6_DEVICE (0x0416)   // HSW
+  IGD_GEN6_DEVICE (0x041a)   // HSW
+  IGD_GEN6_DEVICE (0x041b)   // HSW
+  IGD_GEN6_DEVICE (0x041e)   // HSW
+  IGD_GEN6_DEVICE (0x0422)   // HSW
+  IGD_GEN6_DEVICE (0x0426)   // HSW
+  IGD_GEN6_DEVICE (0x042a)   // HSW
+  IGD_GEN6_DEVICE (0x042b)   // HSW
+  IGD_GEN6_DEVICE (0x042e)   // HSW
+  IGD_GEN6_DEVICE (0x0a02)   // HSW
+  IGD_GEN6_DEVICE (0x0a06)   // HSW
+  IGD_GEN6_DEVICE (0x0a0a)   // HSW
+  IGD_GEN6_DEVICE (0x0a0b)   // HSW
+  IGD_GEN6_DEVICE (0x0a0e)   // HSW
+  IGD_GEN6_DEVICE (0x0a12)   // HSW
+  IGD_GEN6_DEVICE (0x0a16)   // HSW
+  IGD_GEN6_DEVICE (0x0a1a)   // HSW
+  IGD_GEN6_DEVICE (0x0a1b)   // HSW
+  IGD_GEN6_DEVICE (0x0a1e)   // HSW
+  IGD_GEN6_DEVICE (0x0a22)   // HSW
+  IGD_GEN6_DEVICE (0x0a26)   // HSW
+  IGD_GEN6_DEVICE (0x0a2a)   // HSW
+  IGD_GEN6_DEVICE (0x0a2b)   // HSW
+  IGD_GEN6_DEVICE (0x0a2e)   // HSW
+  IGD_GEN9_DEVICE (0x0a84)   // BXT
+  IGD_GEN6_DEVICE (0x0c02)   // HSW
+  IGD_GEN6_DEVICE (0x0c06)   // HSW
+  IGD_GEN6_DEVICE (0x0c0a)   // HSW
+  IGD_GEN6_DEVICE (0x0c0b)   // HSW
+  IGD_GEN6_DEVICE (0x0c0e)   // HSW
+  IGD_GEN6_DEVICE (0x0c12)   // HSW
+  IGD_GEN6_DEVICE (0x0c16)   // HSW
+  IGD_GEN6_DEVICE (0x0c1a)   // HSW
+  IGD_GEN6_DEVICE (0x0c1b)   // HSW
+  IGD_GEN6_DEVICE (0x0c1e)   // HSW
+  IGD_GEN6_DEVICE (0x0c22)   // HSW
+  IGD_GEN6_DEVICE (0x0c26)   // HSW
+  IGD_GEN6_DEVICE (0x0c2a)   // HSW
+  IGD_GEN6_DEVICE (0x0c2b)   // HSW
+  IGD_GEN6_DEVICE (0x0c2e)   // HSW
+  IGD_GEN6_DEVICE (0x0d02)   // HSW
+  IGD_GEN6_DEVICE (0x0d06)   // HSW
+  IGD_GEN6_DEVICE (0x0d0a)   // HSW
+  IGD_GEN6_DEVICE (0x0d0b)   // HSW
+  IGD_GEN6_DEVICE (0x0d0e)   // HSW
+  IGD_GEN6_DEVICE (0x0d12)   // HSW
+  IGD_GEN6_DEVICE (0x0d16)   // HSW
+  IGD_GEN6_DEVICE (0x0d1a)   // HSW
+  IGD_GEN6_DEVICE (0x0d1b)   // HSW
+  IGD_GEN6_DEVICE (0x0d1e)   // HSW
+  IGD_GEN6_DEVICE (0x0d22)   // HSW
+  IGD_GEN6_DEVICE (0x0d26)   // HSW
+  IGD_GEN6_DEVICE (0x0d2a)   // HSW
+  IGD_GEN6_DEVICE (0x0d2b)   // HSW
+  IGD_GEN6_DEVICE (0x0d2e)   // HSW
+  IGD_GEN6_DEVICE (0x0f30)   // VLV
+  IGD_GEN6_DEVICE (0x0f31)   // VLV
+  IGD_GEN6_DEVICE (0x0f32)   // VLV
+  IGD_GEN6_DEVICE (0x0f33)   // VLV
+  IGD_GEN8_DEVICE (0x1602)   // BDW
+  IGD_GEN8_DEVICE (0x1606)   // BDW
+  IGD_GEN8_DEVICE (0x160a)   // BDW
+  IGD_GEN8_DEVICE (0x160b)   // BDW
+  IGD_GEN8_DEVICE (0x160d)   // BDW
+  IGD_GEN8_DEVICE (0x160e)   // BDW
+  IGD_GEN8_DEVICE (0x1612)   // BDW
+  IGD_GEN8_DEVICE (0x1616)   // BDW
+  IGD_GEN8_DEVICE (0x161a)   // BDW
+  IGD_GEN8_DEVICE (0x161b)   // BDW
+  IGD_GEN8_DEVICE (0x161d)   // BDW
+  IGD_GEN8_DEVICE (0x161e)   // BDW
+  IGD_GEN8_DEVICE (0x1622)   // BDW
+  IGD_GEN8_DEVICE (0x1626)   // BDW
+  IGD_GEN8_DEVICE (0x162a)   // BDW
+  IGD_GEN8_DEVICE (0x162b)   // BDW
+  IGD_GEN8_DEVICE (0x162d)   // BDW
+  IGD_GEN8_DEVICE (0x162e)   // BDW
+  IGD_GEN8_DEVICE (0x1632)   // BDW
+  IGD_GEN8_DEVICE (0x1636)   // BDW
+  IGD_GEN8_DEVICE (0x163a)   // BDW
+  IGD_GEN8_DEVICE (0x163b)   // BDW
+  IGD_GEN8_DEVICE (0x163d)   // BDW
+  IGD_GEN8_DEVICE (0x163e)   // BDW
+  IGD_GEN9_DEVICE (0x1902)   // SKL
+  IGD_GEN9_DEVICE (0x1906)   // SKL
+  IGD_GEN9_DEVICE (0x190a)   // SKL
+  IGD_GEN9_DEVICE (0x190b)   // SKL
+  IGD_GEN9_DEVICE (0x190e)   // SKL
+  IGD_GEN9_DEVICE (0x1912)   // SKL
+  IGD_GEN9_DEVICE (0x1913)   // SKL
+  IGD_GEN9_DEVICE (0x1915)   // SKL
+  IGD_GEN9_DEVICE (0x1916)   // SKL
+  IGD_GEN9_DEVICE (0x1917)   // SKL
+  IGD_GEN9_DEVICE (0x191a)   // SKL
+  IGD_GEN9_DEVICE (0x191b)   // SKL
+  IGD_GEN9_DEVICE (0x191d)   // SKL
+  IGD_GEN9_DEVICE (0x191e)   // SKL
+  IGD_GEN9_DEVICE (0x1921)   // SKL
+  IGD_GEN9_DEVICE (0x1923)   // SKL
+  IGD_GEN9_DEVICE (0x1926)   // SKL
+  IGD_GEN9_DEVICE (0x1927)   // SKL
+  IGD_GEN9_DEVICE (0x192a)   // SKL
+  IGD_GEN9_DEVICE (0x192b)   // SKL
+  IGD_GEN9_DEVICE (0x192d)   // SKL
+  IGD_GEN9_DEVICE (0x1932)   // SKL
+  IGD_GEN9_DEVICE (0x193a)   // SKL
+  IGD_GEN9_DEVICE (0x193b)   // SKL
+  IGD_GEN9_DEVICE (0x193d)   // SKL
+  IGD_GEN9_DEVICE (0x1a84)   // BXT
+  IGD_GEN9_DEVICE (0x1a85)   // BXT
+  IGD_CHV_DEVICE (0x22b0)    // CHV
+  IGD_CHV_DEVICE (0x22b1)    // CHV
+  IGD_CHV_DEVICE (0x22b2)    // CHV
+  IGD_CHV_DEVICE (0x22b3)    // CHV
+  IGD_GEN9_DEVICE (0x3184)   // GLK
+  IGD_GEN9_DEVICE (0x3185)   // GLK
+  IGD_GEN9_DEVICE (0x3e90)   // CFL
+  IGD_GEN9_DEVICE (0x3e91)   // CFL
+  IGD_GEN9_DEVICE (0x3e92)   // CFL
+  IGD_GEN9_DEVICE (0x3e93)   // CFL
+  IGD_GEN9_DEVICE (0x3e94)   // CFL
+  IGD_GEN9_DEVICE (0x3e96)   // CFL
+  IGD_GEN9_DEVICE (0x3e98)   // CFL
+  IGD_GEN9_DEVICE (0x3e99)   // CFL
+  IGD_GEN9_DEVICE (0x3e9a)   // CFL
+  IGD_GEN9_DEVICE (0x3e9b)   // CFL
+  IGD_GEN9_DEVICE (0x3e9c)   // CFL
+  IGD_GEN9_DEVICE (0x3ea0)   // WHL
+  IGD_GEN9_DEVICE (0x3ea1)   // WHL
+  IGD_GEN9_DEVICE (0x3ea2)   // WHL
+  IGD_GEN9_DEVICE (0x3ea3)   // WHL
+  IGD_GEN9_DEVICE (0x3ea4)   // WHL
+  IGD_GEN9_DEVICE (0x3ea5)   // CFL
+  IGD_GEN9_DEVICE (0x3ea6)   // CFL
+  IGD_GEN9_DEVICE (0x3ea7)   // CFL
+  IGD_GEN9_DEVICE (0x3ea8)   // CFL
+  IGD_GEN9_DEVICE (0x3ea9)   // CFL
+  IGD_GEN11_DEVICE (0x4541)  // EHL
+  IGD_GEN11_DEVICE (0x4551)  // EHL
+  IGD_GEN11_DEVICE (0x4555)  // EHL
+  IGD_GEN11_DEVICE (0x4557)  // EHL
+  IGD_GEN11_DEVICE (0x4570)  // EHL
+  IGD_GEN11_DEVICE (0x4571)  // EHL
+  IGD_GEN11_DEVICE (0x4626)  // ADLP
+  IGD_GEN11_DEVICE (0x4628)  // ADLP
+  IGD_GEN11_DEVICE (0x462a)  // ADLP
+  IGD_GEN11_DEVICE (0x4680)  // ADLS
+  IGD_GEN11_DEVICE (0x4682)  // ADLS
+  IGD_GEN11_DEVICE (0x4688)  // ADLS
+  IGD_GEN11_DEVICE (0x468a)  // ADLS
+  IGD_GEN11_DEVICE (0x468b)  // ADLS
+  IGD_GEN11_DEVICE (0x4690)  // ADLS
+  IGD_GEN11_DEVICE (0x4692)  // ADLS
+  IGD_GEN11_DEVICE (0x4693)  // ADLS
+  IGD_GEN11_DEVICE (0x46a0)  // ADLP
+  IGD_GEN11_DEVICE (0x46a1)  // ADLP
+  IGD_GEN11_DEVICE (0x46a2)  // ADLP
+  IGD_GEN11_DEVICE (0x46a3)  // ADLP
+  IGD_GEN11_DEVICE (0x46a6)  // ADLP
+  IGD_GEN11_DEVICE (0x46a8)  // ADLP
+  IGD_GEN11_DEVICE (0x46aa)  // ADLP
+  IGD_GEN11_DEVICE (0x46b0)  // ADLP
+  IGD_GEN11_DEVICE (0x46b1)  // ADLP
+  IGD_GEN11_DEVICE (0x46b2)  // ADLP
+  IGD_GEN11_DEVICE (0x46b3)  // ADLP
+  IGD_GEN11_DEVICE (0x46c0)  // ADLP
+  IGD_GEN11_DEVICE (0x46c1)  // ADLP
+  IGD_GEN11_DEVICE (0x46c2)  // ADLP
+  IGD_GEN11_DEVICE (0x46c3)  // ADLP
+  IGD_GEN11_DEVICE (0x46d0)  // ADLN
+  IGD_GEN11_DEVICE (0x46d1)  // ADLN
+  IGD_GEN11_DEVICE (0x46d2)  // ADLN
+  IGD_GEN11_DEVICE (0x46d3)  // ADLN
+  IGD_GEN11_DEVICE (0x46d4)  // ADLN
+  IGD_GEN11_DEVICE (0x4c80)  // RKL
+  IGD_GEN11_DEVICE (0x4c8a)  // RKL
+  IGD_GEN11_DEVICE (0x4c8b)  // RKL
+  IGD_GEN11_DEVICE (0x4c8c)  // RKL
+  IGD_GEN11_DEVICE (0x4c90)  // RKL
+  IGD_GEN11_DEVICE (0x4c9a)  // RKL
+  IGD_GEN11_DEVICE (0x4e51)  // JSL
+  IGD_GEN11_DEVICE (0x4e55)  // JSL
+  IGD_GEN11_DEVICE (0x4e57)  // JSL
+  IGD_GEN11_DEVICE (0x4e61)  // JSL
+  IGD_GEN11_DEVICE (0x4e71)  // JSL
+  IGD_GEN9_DEVICE (0x5902)   // KBL
+  IGD_GEN9_DEVICE (0x5906)   // KBL
+  IGD_GEN9_DEVICE (0x5908)   // KBL
+  IGD_GEN9_DEVICE (0x590a)   // KBL
+  IGD_GEN9_DEVICE (0x590b)   // KBL
+  IGD_GEN9_DEVICE (0x590e)   // KBL
+  IGD_GEN9_DEVICE (0x5912)   // KBL
+  IGD_GEN9_DEVICE (0x5913)   // KBL
+  IGD_GEN9_DEVICE (0x5915)   // KBL
+  IGD_GEN9_DEVICE (0x5916)   // KBL
+  IGD_GEN9_DEVICE (0x5917)   // KBL
+  IGD_GEN9_DEVICE (0x591a)   // KBL
+  IGD_GEN9_DEVICE (0x591b)   // KBL
+  IGD_GEN9_DEVICE (0x591c)   // KBL
+  IGD_GEN9_DEVICE (0x591d)   // KBL
+  IGD_GEN9_DEVICE (0x591e)   // KBL
+  IGD_GEN9_DEVICE (0x5921)   // KBL
+  IGD_GEN9_DEVICE (0x5923)   // KBL
+  IGD_GEN9_DEVICE (0x5926)   // KBL
+  IGD_GEN9_DEVICE (0x5927)   // KBL
+  IGD_GEN9_DEVICE (0x593b)   // KBL
+  IGD_GEN9_DEVICE (0x5a84)   // BXT
+  IGD_GEN9_DEVICE (0x5a85)   // BXT
+  IGD_XE_DEVICE (0x6420)     // LNL
+  IGD_XE_DEVICE (0x64a0)     // LNL
+  IGD_XE_DEVICE (0x64b0)     // LNL
+  IGD_XE_DEVICE (0x7d40)     // MTL
+  IGD_XE_DEVICE (0x7d41)     // ARL
+  IGD_XE_DEVICE (0x7d45)     // MTL
+  IGD_XE_DEVICE (0x7d51)     // ARL
+  IGD_XE_DEVICE (0x7d55)     // MTL
+  IGD_XE_DEVICE (0x7d60)     // MTL
+  IGD_XE_DEVICE (0x7d67)     // ARL
+  IGD_XE_DEVICE (0x7dd1)     // ARL
+  IGD_XE_DEVICE (0x7dd5)     // MTL
+  IGD_GEN9_DEVICE (0x87c0)   // KBL
+  IGD_GEN9_DEVICE (0x87ca)   // CFL
+  IGD_GEN11_DEVICE (0x8a50)  // ICL
+  IGD_GEN11_DEVICE (0x8a51)  // ICL
+  IGD_GEN11_DEVICE (0x8a52)  // ICL
+  IGD_GEN11_DEVICE (0x8a53)  // ICL
+  IGD_GEN11_DEVICE (0x8a54)  // ICL
+  IGD_GEN11_DEVICE (0x8a56)  // ICL
+  IGD_GEN11_DEVICE (0x8a57)  // ICL
+  IGD_GEN11_DEVICE (0x8a58)  // ICL
+  IGD_GEN11_DEVICE (0x8a59)  // ICL
+  IGD_GEN11_DEVICE (0x8a5a)  // ICL
+  IGD_GEN11_DEVICE (0x8a5b)  // ICL
+  IGD_GEN11_DEVICE (0x8a5c)  // ICL
+  IGD_GEN11_DEVICE (0x8a5d)  // ICL
+  IGD_GEN11_DEVICE (0x8a70)  // ICL
+  IGD_GEN11_DEVICE (0x8a71)  // ICL
+  IGD_GEN11_DEVICE (0x9a40)  // TGL
+  IGD_GEN11_DEVICE (0x9a49)  // TGL
+  IGD_GEN11_DEVICE (0x9a59)  // TGL
+  IGD_GEN11_DEVICE (0x9a60)  // TGL
+  IGD_GEN11_DEVICE (0x9a68)  // TGL
+  IGD_GEN11_DEVICE (0x9a70)  // TGL
+  IGD_GEN11_DEVICE (0x9a78)  // TGL
+  IGD_GEN11_DEVICE (0x9ac0)  // TGL
+  IGD_GEN11_DEVICE (0x9ac9)  // TGL
+  IGD_GEN11_DEVICE (0x9ad9)  // TGL
+  IGD_GEN11_DEVICE (0x9af8)  // TGL
+  IGD_GEN9_DEVICE (0x9b21)   // CML
+  IGD_GEN9_DEVICE (0x9b41)   // CML
+  IGD_GEN9_DEVICE (0x9ba2)   // CML
+  IGD_GEN9_DEVICE (0x9ba4)   // CML
+  IGD_GEN9_DEVICE (0x9ba5)   // CML
+  IGD_GEN9_DEVICE (0x9ba8)   // CML
+  IGD_GEN9_DEVICE (0x9baa)   // CML
+  IGD_GEN9_DEVICE (0x9bac)   // CML
+  IGD_GEN9_DEVICE (0x9bc2)   // CML
+  IGD_GEN9_DEVICE (0x9bc4)   // CML
+  IGD_GEN9_DEVICE (0x9bc5)   // CML
+  IGD_GEN9_DEVICE (0x9bc6)   // CML
+  IGD_GEN9_DEVICE (0x9bc8)   // CML
+  IGD_GEN9_DEVICE (0x9bca)   // CML
+  IGD_GEN9_DEVICE (0x9bcc)   // CML
+  IGD_GEN9_DEVICE (0x9be6)   // CML
+  IGD_GEN9_DEVICE (0x9bf6)   // CML
+  IGD_GEN11_DEVICE (0xa720)  // RPLP
+  IGD_GEN11_DEVICE (0xa721)  // RPLU
+  IGD_GEN11_DEVICE (0xa780)  // RPLS
+  IGD_GEN11_DEVICE (0xa781)  // RPLS
+  IGD_GEN11_DEVICE (0xa782)  // RPLS
+  IGD_GEN11_DEVICE (0xa783)  // RPLS
+  IGD_GEN11_DEVICE (0xa788)  // RPLS
+  IGD_GEN11_DEVICE (0xa789)  // RPLS
+  IGD_GEN11_DEVICE (0xa78a)  // RPLS
+  IGD_GEN11_DEVICE (0xa78b)  // RPLS
+  IGD_GEN11_DEVICE (0xa7a0)  // RPLP
+  IGD_GEN11_DEVICE (0xa7a1)  // RPLU
+  IGD_GEN11_DEVICE (0xa7a8)  // RPLP
+  IGD_GEN11_DEVICE (0xa7a9)  // RPLU
+  IGD_GEN11_DEVICE (0xa7aa)  // RPLP
+  IGD_GEN11_DEVICE (0xa7ab)  // RPLP
+  IGD_GEN11_DEVICE (0xa7ac)  // RPLU
+  IGD_GEN11_DEVICE (0xa7ad)  // RPLU
+  IGD_XE_DEVICE (0xb080)     // PTL
+  IGD_XE_DEVICE (0xb081)     // PTL
+  IGD_XE_DEVICE (0xb082)     // PTL
+  IGD_XE_DEVICE (0xb083)     // PTL
+  IGD_XE_DEVICE (0xb084)     // PTL
+  IGD_XE_DEVICE (0xb085)     // PTL
+  IGD_XE_DEVICE (0xb086)     // PTL
+  IGD_XE_DEVICE (0xb087)     // PTL
+  IGD_XE_DEVICE (0xb08f)     // PTL
+  IGD_XE_DEVICE (0xb090)     // PTL
+  IGD_XE_DEVICE (0xb0a0)     // PTL
+  IGD_XE_DEVICE (0xb0b0)     // PTL
+  IGD_XE_DEVICE (0xb640)     // ARL
+  IGD_XE_DEVICE (0xd740)     // NVLS
+  IGD_XE_DEVICE (0xd741)     // NVLS
+  IGD_XE_DEVICE (0xd742)     // NVLS
+  IGD_XE_DEVICE (0xd743)     // NVLS
+  IGD_XE_DEVICE (0xd744)     // NVLS
+  IGD_XE_DEVICE (0xd745)     // NVLS
+  IGD_XE_DEVICE (0xd750)     // NVLP
+  IGD_XE_DEVICE (0xd751)     // NVLP
+  IGD_XE_DEVICE (0xd752)     // NVLP
+  IGD_XE_DEVICE (0xd753)     // NVLP
+  IGD_XE_DEVICE (0xd754)     // NVLP
+  IGD_XE_DEVICE (0xd755)     // NVLP
+  IGD_XE_DEVICE (0xd756)     // NVLP
+  IGD_XE_DEVICE (0xd757)     // NVLP
+  IGD_XE_DEVICE (0xd75f)     // NVLP
+  IGD_XE_DEVICE (0xfd80)     // WCL
+  IGD_XE_DEVICE (0xfd81)     // WCL
 };
 
-STATIC CONST IGD_PRIVATE_DATA Gen9Private = {
-  .Flags = IGD_FLAG_BDSM_32BIT,
-  .GetStolenSize = Gen9StolenSize,
-};
+/**
+  Find the entry of a device ID in IgdDeviceTable.
 
-STATIC CONST IGD_PRIVATE_DATA Gen11Private = {
-  .Flags = IGD_FLAG_BDSM_64BIT,
-  .GetStolenSize = Gen9StolenSize,
-};
+  @param[in]  DeviceId  IGD Device ID
 
-STATIC CONST IGD_PRIVATE_DATA NullPrivate = {
-  .Flags = 0,
-  .GetStolenSize = NULL,
-};
+  @return  The entry, or NULL if the device ID is not in the table.
+**/
+STATIC
+CONST IGD_DEVICE_INFO *
+FindDevice (
+  IN UINT16 DeviceId
+  )
+{
+  UINTN Low;
+  UINTN High;
+  UINTN Middle;
+
+  Low  = 0;
+  High = ARRAY_SIZE (IgdDeviceTable);
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    if (IgdDeviceTable[Middle].DeviceId < DeviceId) {
+      Low = Middle + 1;
+    } else {
+      High = Middle;
+    }
+  }
 
-STATIC CONST IGD_DEVICE_INFO IgdDeviceTable[] = {
-  INTEL_SNB_IDS(IGD_DEVICE, &Gen6Private),
-  INTEL_IVB_IDS(IGD_DEVICE, &Gen6Private),
-  INTEL_HSW_IDS(IGD_DEVICE, &Gen6Private),
-  INTEL_VLV_IDS(IGD_DEVICE, &Gen6Private),
-  INTEL_BDW_IDS(IGD_DEVICE, &Gen8Private),
-  INTEL_CHV_IDS(IGD_DEVICE, &ChvPrivate),
-  INTEL_SKL_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_BXT_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_KBL_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_CFL_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_WHL_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_CML_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_GLK_IDS(IGD_DEVICE, &Gen9Private),
-  INTEL_ICL_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_EHL_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_JSL_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_TGL_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_RKL_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_ADLS_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_ADLP_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_ADLN_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_RPLS_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_RPLU_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_RPLP_IDS(IGD_DEVICE, &Gen11Private),
-  INTEL_MTL_IDS(IGD_DEVICE, &NullPrivate),
-  INTEL_ARL_IDS(IGD_DEVICE, &NullPrivate),
-  INTEL_LNL_IDS(IGD_DEVICE, &NullPrivate),
-  INTEL_PTL_IDS(IGD_DEVICE, &NullPrivate),
-  INTEL_WCL_IDS(IGD_DEVICE, &NullPrivate),
-  INTEL_NVLS_IDS(IGD_DEVICE, &NullPrivate),
-  INTEL_NVLP_IDS(IGD_DEVICE, &NullPrivate),
-};
+  if (Low == ARRAY_SIZE (IgdDeviceTable) ||
+      IgdDeviceTable[Low].DeviceId != DeviceId) {
+    return NULL;
+  }
+  return &IgdDeviceTable[Low];
+}
 
 /**
   Get IGD device private data based on Device ID
@@ -191,16 +669,24 @@ GetIgdPrivateData (
   OUT CONST IGD_PRIVATE_DATA  **PrivateData
   )
 {
-  UINTN   Index;
-
-  for (Index = 0; Index < ARRAY_SIZE(IgdDeviceTable); Index++) {
-    if (DeviceId == IgdDeviceTable[Index].DeviceId) {
-      *PrivateData = IgdDeviceTable[Index].Private;
-      DEBUG ((DEBUG_INFO, "%a: Device: %x, Flag: %x\n", __FUNCTION__,
-              DeviceId, (*PrivateData)->Flags));
-      return EFI_SUCCESS;
-    }
+  CONST IGD_DEVICE_INFO *Device;
+
+  DEBUG_CODE_BEGIN ();
+  UINTN Index;
+
+  for (Index = 1; Index < ARRAY_SIZE (IgdDeviceTable); Index++) {
+    ASSERT (IgdDeviceTable[Index - 1].DeviceId <
+            IgdDeviceTable[Index].DeviceId);
+  }
+  DEBUG_CODE_END ();
+
+  Device = FindDevice (DeviceId);
+  if (Device == NULL) {
+    return EFI_UNSUPPORTED;
   }
 
-  return EFI_UNSUPPORTED;
+  *PrivateData = &IgdPrivateTable[Device->Generation];
+  DEBUG ((DEBUG_INFO, "%a: Device: %x, Flag: %x\n", __FUNCTION__,
+          DeviceId, (*PrivateData)->Flags));
+  return EFI_SUCCESS;
 }
@@ -25,6 +25,112 @@
 #define ASSIGNED_IGD_FW_CFG_OPREGION  "etc/igd-opregion"
 #define ASSIGNED_IGD_FW_CFG_BDSM_SIZE "etc/igd-bdsm-size"
 
+//
+// Names of optional fw_cfg knobs. These are not part of QEMU's specification;
+// the host passes them with "-fw_cfg name=opt/...,string=...".
+//
+// ASSIGNED_IGD_FW_CFG_BDSM_CLEAR is a boolean. Setting it to false skips
+// zeroing stolen memory, for hosts that guarantee zero-filled guest RAM (such
+// as on a cold boot) and that want the pages to remain unpopulated.
+//
+#define ASSIGNED_IGD_FW_CFG_BDSM_CLEAR "opt/igd-bdsm-clear"
+//
+// ASSIGNED_IGD_FW_CFG_BDSM_ABOVE_4G is a boolean. Setting it to true places
+// stolen memory as high as possible for devices with a 64-bit BDSM register,
+// leaving the 32-bit address space to other consumers.
+//
+#define ASSIGNED_IGD_FW_CFG_BDSM_ABOVE_4G "opt/igd-bdsm-above-4g"
+//
+// ASSIGNED_IGD_FW_CFG_BDSM_RANGE holds an ASSIGNED_IGD_FW_CFG_RANGE, and is
+// passed with "-fw_cfg name=opt/igd-bdsm-range,file=...". It designates the
+// guest-physical range that the host has set aside for stolen memory; the
+// range is claimed and programmed into BDSM as is, without clearing it. The
+// range must either be RAM, or be reported as reserved memory by the host.
+//
+#define ASSIGNED_IGD_FW_CFG_BDSM_RANGE "opt/igd-bdsm-range"
+//
+// ASSIGNED_IGD_FW_CFG_NUMA_NODE is a decimal integer naming the proximity
+// domain, as described by the SRAT, to place the OpRegion and stolen memory
+// in. Placement falls back to any node if the domain lacks suitable memory.
+//
+#define ASSIGNED_IGD_FW_CFG_NUMA_NODE "opt/igd-numa-node"
+//
+// ASSIGNED_IGD_FW_CFG_DEVICE_INFO holds an ASSIGNED_IGD_FW_CFG_DEVICE_INFO
+// describing the IGD at the fixed location, and is passed with
+// "-fw_cfg name=opt/igd-device-info,file=...". It takes the place of the
+// driver's built-in device table, so that devices the table doesn't know can
+// be assigned without rebuilding the option ROM. A nonzero StolenSize takes
+// the place of decoding the GMCH register, but ASSIGNED_IGD_FW_CFG_BDSM_SIZE
+// still takes precedence. A zero StolenSize leaves the GMCH register to the
+// built-in decoder, if the device is in the built-in table. A nonzero
+// StolenSize requires one of the ASSIGNED_IGD_DEVICE_INFO_BDSM_* flags.
+//
+#define ASSIGNED_IGD_FW_CFG_DEVICE_INFO "opt/igd-device-info"
+//
+// ASSIGNED_IGD_FW_CFG_SRIOV_VF is a boolean. Setting it to true declares that
+// the guest has only SR-IOV virtual functions of the IGD assigned. Those use
+// neither the OpRegion nor stolen memory, so the driver sets up nothing.
+//
+#define ASSIGNED_IGD_FW_CFG_SRIOV_VF "opt/igd-sriov-vf"
+//
+// Per-device variants of ASSIGNED_IGD_FW_CFG_OPREGION and
+// ASSIGNED_IGD_FW_CFG_BDSM_SIZE, for guests with more than one Intel display
+// device. The file names are formed by appending the PCI address of the
+// device, as in "opt/igd-opregion/0000:00:02.0". A per-device OpRegion takes
+// precedence over ASSIGNED_IGD_FW_CFG_OPREGION. A device with a per-device
+// stolen memory size gets stolen memory regardless of its location.
+//
+#define ASSIGNED_IGD_FW_CFG_OPREGION_DIR "opt/igd-opregion/"
+#define ASSIGNED_IGD_FW_CFG_BDSM_SIZE_DIR "opt/igd-bdsm-size/"
+//
+// ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS is a sparse encoding of
+// ASSIGNED_IGD_FW_CFG_OPREGION, and takes precedence over it. Most of an
+// OpRegion is zero-filled mailboxes, which then need not be transferred. The
+// file consists of an ASSIGNED_IGD_FW_CFG_EXTENTS_HEADER, followed by any
+// number of ASSIGNED_IGD_FW_CFG_EXTENT structures, each directly followed by
+// Length bytes of data. Extents must be in ascending order and must not
+// overlap. OpRegion bytes not covered by any extent are zero.
+//
+#define ASSIGNED_IGD_FW_CFG_OPREGION_EXTENTS "opt/igd-opregion-extents"
+//
+// ASSIGNED_IGD_FW_CFG_OPREGION_RANGE holds an ASSIGNED_IGD_FW_CFG_RANGE, and
+// is passed with "-fw_cfg name=opt/igd-opregion-range,file=...". It designates
+// a page-aligned guest-physical range below 4GB where the host has already
+// mapped the OpRegion, including any RVDA VBT. The range is claimed as ACPI
+// NVS and programmed into ASLS as is, so the OpRegion isn't downloaded. If the
+// range lacks the OpRegion signature, the OpRegion is downloaded as usual.
+//
+#define ASSIGNED_IGD_FW_CFG_OPREGION_RANGE "opt/igd-opregion-range"
+
+#pragma pack (1)
+typedef struct {
+  UINT64 Base;      // little endian
+  UINT64 Size;      // little endian
+} ASSIGNED_IGD_FW_CFG_RANGE;
+
+typedef struct {
+  UINT32 Generation;  // little endian, informational only
+  UINT32 Flags;       // little endian, ASSIGNED_IGD_DEVICE_INFO_* below
+  UINT64 StolenSize;  // little endian, in bytes
+} ASSIGNED_IGD_FW_CFG_DEVICE_INFO;
+
+typedef struct {
+  UINT32 Size;        // little endian, size of the expanded OpRegion
+} ASSIGNED_IGD_FW_CFG_EXTENTS_HEADER;
+
+typedef struct {
+  UINT32 Offset;      // little endian, offset into the OpRegion
+  UINT32 Length;      // little endian, number of data bytes that follow
+} ASSIGNED_IGD_FW_CFG_EXTENT;
+#pragma pack ()
+
+//
+// Width of the BDSM register. A device with neither flag set has no stolen
+// memory to set up.
+//
+#define ASSIGNED_IGD_DEVICE_INFO_BDSM_32BIT BIT0
+#define ASSIGNED_IGD_DEVICE_INFO_BDSM_64BIT BIT1
+
 //
 // Alignment constants. UEFI page allocation automatically satisfies the
 // requirements for the OpRegion, thus we only need to define an alignment
@@ -36,6 +142,7 @@
 // PCI config space registers. The naming follows the PCI_*_OFFSET pattern seen
 // in MdePkg/Include/IndustryStandard/Pci*.h.
 //
+#define ASSIGNED_IGD_PCI_GMCH_OFFSET 0x50
 #define ASSIGNED_IGD_PCI_GSM_SIZE_OFFSET 0x51
 #define ASSIGNED_IGD_PCI_BDSM_OFFSET 0x5C
 #define ASSIGNED_IGD_PCI_BDSM64_OFFSET 0xC0
@@ -44,6 +151,7 @@
 //
 // PCI location and vendor
 //
+#define ASSIGNED_IGD_PCI_SEGMENT   0x0000
 #define ASSIGNED_IGD_PCI_BUS       0x00
 #define ASSIGNED_IGD_PCI_DEVICE    0x02
 #define ASSIGNED_IGD_PCI_FUNCTION  0x0
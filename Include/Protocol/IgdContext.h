@@ -0,0 +1,57 @@
+/** @file
+
+  Package-private protocol that IgdAssignmentDxe installs on the handle of
+  each Intel display device it has set up, describing what it has set up. Its
+  consumers need neither rediscover the device nor read its config space.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _IGD_CONTEXT_PROTOCOL_H_
+#define _IGD_CONTEXT_PROTOCOL_H_
+
+#define IGD_CONTEXT_PROTOCOL_GUID \
+  { 0xa749ac2f, 0xc7e0, 0x44c6, { 0x82, 0x85, 0xc4, 0xc1, 0xef, 0x06, 0xfe, 0x68 } }
+
+#define IGD_CONTEXT_PROTOCOL_REVISION  0x01
+
+//
+// Width of the BDSM register
+//
+#define IGD_CONTEXT_BDSM_32BIT  BIT0
+#define IGD_CONTEXT_BDSM_64BIT  BIT1
+
+typedef struct {
+  UINT32               Revision;
+  //
+  // PCI location of the device
+  //
+  UINTN                Segment;
+  UINTN                Bus;
+  UINTN                Device;
+  UINTN                Function;
+  //
+  // IGD_CONTEXT_BDSM_* flags
+  //
+  UINT32               Flags;
+  //
+  // OpRegion programmed into ASLS; zero if none has been set up
+  //
+  EFI_PHYSICAL_ADDRESS OpRegion;
+  UINTN                OpRegionSize;
+  //
+  // stolen memory programmed into BDSM; zero if none has been set up
+  //
+  EFI_PHYSICAL_ADDRESS Bdsm;
+  UINTN                BdsmSize;
+} IGD_CONTEXT_PROTOCOL;
+
+extern EFI_GUID gIgdContextProtocolGuid;
+
+#endif
@@ -0,0 +1,55 @@
+/** @file
+
+  Package-private protocol that publishes the fw_cfg file directory, read once
+  by IgdAssignmentDxe, so that other VfioIgdPkg drivers can look up fw_cfg
+  files without walking the directory again.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _IGD_FW_CFG_INDEX_PROTOCOL_H_
+#define _IGD_FW_CFG_INDEX_PROTOCOL_H_
+
+#include <Library/QemuFwCfgLib.h>
+
+#define IGD_FW_CFG_INDEX_PROTOCOL_GUID \
+  { 0x1d5f8a5d, 0xf8b6, 0x4c3c, { 0x98, 0xfe, 0x37, 0xcd, 0xfa, 0xe0, 0xb3, 0x7f } }
+
+#define IGD_FW_CFG_INDEX_PROTOCOL_REVISION  0x01
+
+typedef struct _IGD_FW_CFG_INDEX_PROTOCOL IGD_FW_CFG_INDEX_PROTOCOL;
+
+/**
+  Find the named fw_cfg file in the index. This involves no fw_cfg access.
+
+  @param[in]  This  The protocol instance.
+  @param[in]  Name  Name of the fw_cfg file.
+  @param[out] Item  The fw_cfg selector of the file.
+  @param[out] Size  The size of the file.
+
+  @retval EFI_SUCCESS    The file has been found.
+  @retval EFI_NOT_FOUND  There is no such file.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *IGD_FW_CFG_INDEX_FIND_FILE) (
+  IN  IGD_FW_CFG_INDEX_PROTOCOL *This,
+  IN  CONST CHAR8               *Name,
+  OUT FIRMWARE_CONFIG_ITEM      *Item,
+  OUT UINTN                     *Size
+  );
+
+struct _IGD_FW_CFG_INDEX_PROTOCOL {
+  UINT32                     Revision;
+  IGD_FW_CFG_INDEX_FIND_FILE FindFile;
+};
+
+extern EFI_GUID gIgdFwCfgIndexProtocolGuid;
+
+#endif
@@ -0,0 +1,55 @@
+/** @file
+
+  Package-private protocol that looks up BIOS Data Blocks (BDBs) of the VBT
+  handed out by PlatformGopPolicy, without rescanning the VBT.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _IGD_VBT_INDEX_PROTOCOL_H_
+#define _IGD_VBT_INDEX_PROTOCOL_H_
+
+#define IGD_VBT_INDEX_PROTOCOL_GUID \
+  { 0xb33eccde, 0x050e, 0x4522, { 0x96, 0x22, 0x0e, 0x68, 0x47, 0xac, 0x50, 0x1e } }
+
+#define IGD_VBT_INDEX_PROTOCOL_REVISION  0x01
+
+typedef struct _IGD_VBT_INDEX_PROTOCOL IGD_VBT_INDEX_PROTOCOL;
+
+/**
+  Look up a BIOS Data Block of the VBT by its ID.
+
+  @param[in]  This     The protocol instance.
+  @param[in]  BlockId  ID of the block.
+  @param[out] Block    The block data, following the 3-byte block header.
+  @param[out] Size     The size of the block data. From version 3 on, the
+                       MIPI sequence block (ID 53) carries its size in the
+                       block data instead of the block header.
+
+  @retval EFI_SUCCESS    The block has been found.
+  @retval EFI_NOT_FOUND  The VBT has no such block.
+  @return                Error codes from locating the VBT.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *IGD_VBT_INDEX_GET_BLOCK) (
+  IN  IGD_VBT_INDEX_PROTOCOL *This,
+  IN  UINT8                  BlockId,
+  OUT CONST VOID             **Block,
+  OUT UINT32                 *Size
+  );
+
+struct _IGD_VBT_INDEX_PROTOCOL {
+  UINT32                  Revision;
+  IGD_VBT_INDEX_GET_BLOCK GetBlock;
+};
+
+extern EFI_GUID gIgdVbtIndexProtocolGuid;
+
+#endif
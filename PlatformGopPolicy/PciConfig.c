@@ -0,0 +1,208 @@
+/** @file
+
+  PCI config space access through ECAM, with a fallback to CF8. Under KVM a
+  CF8 read is two exits to the host, the address write to 0xCF8 and the data
+  read from 0xCFC, while an ECAM read is a single MMIO exit.
+
+  PciExpressLib can't be used for this, as it takes the ECAM base from a PCD
+  fixed at build time, and the base is up to the VMM. The base is taken from
+  the ACPI MCFG table instead, which QEMU provides for q35 only; finding it
+  costs no config space access of its own. Without an MCFG, as on i440fx,
+  config space is read through CF8.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#include <Guid/Acpi.h>
+#include <IndustryStandard/Acpi.h>
+#include <IndustryStandard/MemoryMappedConfigurationSpaceAccessTable.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/IoLib.h>
+#include <Library/PciLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+#include "PciConfig.h"
+
+typedef EFI_ACPI_MEMORY_MAPPED_CONFIGURATION_BASE_ADDRESS_TABLE_HEADER
+  MCFG_HEADER;
+typedef EFI_ACPI_MEMORY_MAPPED_ENHANCED_CONFIGURATION_SPACE_BASE_ADDRESS_ALLOCATION_STRUCTURE
+  MCFG_ALLOCATION;
+
+//
+// ECAM window of segment 0, found on the first access; mEcamBase is zero if
+// there is none, and config space is read through CF8
+//
+STATIC BOOLEAN mEcamProbed;
+STATIC UINT64  mEcamBase;
+STATIC UINT8   mEcamStartBus;
+STATIC UINT8   mEcamEndBus;
+
+STATIC UINT64  mEcamReads;
+STATIC UINT64  mCf8Reads;
+
+
+/**
+  Find an ACPI table in the XSDT, or in the RSDT if there is no XSDT.
+
+  @param[in] Signature  Signature of the table.
+
+  @return  The table, or NULL if there is no such table.
+**/
+STATIC
+CONST EFI_ACPI_DESCRIPTION_HEADER *
+FindAcpiTable (
+  IN UINT32 Signature
+  )
+{
+  CONST EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER *Rsdp;
+  CONST EFI_ACPI_DESCRIPTION_HEADER                  *Sdt;
+  CONST EFI_ACPI_DESCRIPTION_HEADER                  *Table;
+  UINTN                                              EntrySize;
+  UINTN                                              Entries;
+  UINTN                                              Index;
+  CONST UINT8                                        *Entry;
+  UINT64                                             Address;
+
+  Rsdp = NULL;
+  for (Index = 0; Index < gST->NumberOfTableEntries; Index++) {
+    if (CompareGuid (&gST->ConfigurationTable[Index].VendorGuid,
+                     &gEfiAcpi20TableGuid)) {
+      Rsdp = gST->ConfigurationTable[Index].VendorTable;
+      break;
+    }
+  }
+  if (Rsdp == NULL) {
+    return NULL;
+  }
+
+  if (Rsdp->Revision >= EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER_REVISION &&
+      Rsdp->XsdtAddress != 0) {
+    Sdt       = (CONST EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)Rsdp->XsdtAddress;
+    EntrySize = sizeof (UINT64);
+  } else {
+    Sdt       = (CONST EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)Rsdp->RsdtAddress;
+    EntrySize = sizeof (UINT32);
+  }
+  if (Sdt == NULL || Sdt->Length < sizeof *Sdt) {
+    return NULL;
+  }
+
+  Entries = (Sdt->Length - sizeof *Sdt) / EntrySize;
+  Entry   = (CONST UINT8 *)(Sdt + 1);
+  for (Index = 0; Index < Entries; Index++, Entry += EntrySize) {
+    if (EntrySize == sizeof (UINT64)) {
+      Address = ReadUnaligned64 ((CONST UINT64 *)Entry);
+    } else {
+      Address = ReadUnaligned32 ((CONST UINT32 *)Entry);
+    }
+    Table = (CONST EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)Address;
+    if (Table != NULL && Table->Signature == Signature) {
+      return Table;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+  Find the ECAM window of segment 0 in the MCFG table.
+**/
+STATIC
+VOID
+ProbeEcam (
+  VOID
+  )
+{
+  CONST EFI_ACPI_DESCRIPTION_HEADER *Mcfg;
+  CONST MCFG_ALLOCATION             *Allocation;
+  UINTN                             Allocations;
+  UINTN                             Index;
+
+  mEcamProbed = TRUE;
+
+  Mcfg = FindAcpiTable (
+           EFI_ACPI_3_0_PCI_EXPRESS_MEMORY_MAPPED_CONFIGURATION_SPACE_BASE_ADDRESS_DESCRIPTION_TABLE_SIGNATURE
+           );
+  if (Mcfg == NULL || Mcfg->Length < sizeof (MCFG_HEADER)) {
+    DEBUG ((DEBUG_INFO, "%a: no MCFG, using CF8\n", __FUNCTION__));
+    return;
+  }
+
+  Allocation  = (CONST MCFG_ALLOCATION *)((CONST UINT8 *)Mcfg +
+                                          sizeof (MCFG_HEADER));
+  Allocations = (Mcfg->Length - sizeof (MCFG_HEADER)) / sizeof *Allocation;
+  for (Index = 0; Index < Allocations; Index++, Allocation++) {
+    if (Allocation->PciSegmentGroupNumber == 0 &&
+        Allocation->StartBusNumber <= Allocation->EndBusNumber) {
+      mEcamBase     = Allocation->BaseAddress;
+      mEcamStartBus = Allocation->StartBusNumber;
+      mEcamEndBus   = Allocation->EndBusNumber;
+      DEBUG ((DEBUG_INFO, "%a: ECAM at 0x%Lx, buses 0x%x-0x%x\n", __FUNCTION__,
+        mEcamBase, mEcamStartBus, mEcamEndBus));
+      return;
+    }
+  }
+  DEBUG ((DEBUG_INFO, "%a: no ECAM for segment 0, using CF8\n", __FUNCTION__));
+}
+
+
+/**
+  Read a 32-bit register from the config space of a device in segment 0.
+
+  @param[in] Bus       Bus number of the device.
+  @param[in] Device    Device number of the device.
+  @param[in] Function  Function number of the device.
+  @param[in] Register  Offset of the register; must be 32-bit aligned.
+
+  @return  The value of the register.
+**/
+UINT32
+EFIAPI
+IgdPciRead32 (
+  IN UINTN Bus,
+  IN UINTN Device,
+  IN UINTN Function,
+  IN UINTN Register
+  )
+{
+  if (!mEcamProbed) {
+    ProbeEcam ();
+  }
+
+  //
+  // The MCFG base address is that of bus 0, whatever the start bus.
+  //
+  if (mEcamBase != 0 && Bus >= mEcamStartBus && Bus <= mEcamEndBus) {
+    mEcamReads++;
+    return MmioRead32 ((UINTN)mEcamBase + (UINTN)((Bus << 20) |
+                                                  (Device << 15) |
+                                                  (Function << 12) |
+                                                  Register));
+  }
+
+  mCf8Reads++;
+  return PciRead32 (PCI_LIB_ADDRESS (Bus, Device, Function, Register));
+}
+
+
+/**
+  Log how many config space reads have gone through ECAM and CF8.
+**/
+VOID
+EFIAPI
+ReportPciConfigAccess (
+  VOID
+  )
+{
+  DEBUG ((DEBUG_INFO, "%a: %Lu reads through ECAM, %Lu through CF8; %Lu exits "
+    "instead of %Lu\n", __FUNCTION__, mEcamReads, mCf8Reads,
+    mEcamReads + 2 * mCf8Reads, 2 * (mEcamReads + mCf8Reads)));
+}
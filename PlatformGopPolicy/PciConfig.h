@@ -0,0 +1,48 @@
+/** @file
+
+  Internal function declarations for PCI config space access through ECAM,
+  with a fallback to CF8.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _PCI_CONFIG_H_
+#define _PCI_CONFIG_H_
+
+#include <Uefi.h>
+
+/**
+  Read a 32-bit register from the config space of a device in segment 0.
+
+  @param[in] Bus       Bus number of the device.
+  @param[in] Device    Device number of the device.
+  @param[in] Function  Function number of the device.
+  @param[in] Register  Offset of the register; must be 32-bit aligned.
+
+  @return  The value of the register.
+**/
+UINT32
+EFIAPI
+IgdPciRead32 (
+  IN UINTN Bus,
+  IN UINTN Device,
+  IN UINTN Function,
+  IN UINTN Register
+  );
+
+/**
+  Log how many config space reads have gone through ECAM and CF8.
+**/
+VOID
+EFIAPI
+ReportPciConfigAccess (
+  VOID
+  );
+
+#endif
@@ -16,20 +16,76 @@ Copyright (c)  1999  - 2019, Intel Corporation. All rights reserved
 /** @file
 **/
 
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/EdidOverride.h>
 #include <Protocol/FirmwareVolume2.h>
+#include <Protocol/IgdContext.h>
+#include <Protocol/IgdVbtIndex.h>
 #include <Protocol/PlatformGopPolicy.h>
 
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
-#include <Library/PciLib.h>
 
 #include <IndustryStandard/AssignedIgd.h>
 #include <IndustryStandard/IgdOpRegion.h>
 
+#include "PciConfig.h"
+#include "VbtIndex.h"
+
 PLATFORM_GOP_POLICY_PROTOCOL  mPlatformGopPolicy;
+
+//
+// VBT handed out by GetVbtData, either in place in the OpRegion or a copy with
+// a fixed checksum; zero until the first successful call
+//
 EFI_PHYSICAL_ADDRESS mVbt;
+UINT32 mVbtSize;
+
+//
+// Whether the BDB blocks of mVbt have been indexed
+//
+BOOLEAN mVbtIndexed;
+
+EFI_STATUS
+EFIAPI
+GetVbtBlock (
+  IN  IGD_VBT_INDEX_PROTOCOL *This,
+  IN  UINT8                  BlockId,
+  OUT CONST VOID             **Block,
+  OUT UINT32                 *Size
+  );
+
+IGD_VBT_INDEX_PROTOCOL mVbtIndex = {
+  IGD_VBT_INDEX_PROTOCOL_REVISION,
+  GetVbtBlock
+};
+
+//
+// The low two bits of the PHED of OpRegion Mailbox 5 give the number of valid
+// 128-byte EDID blocks in BDDC. The base block gives the number of extension
+// blocks that follow it at offset 0x7E.
+//
+#define OPREGION_PHED_EDID_BLOCKS 0x3
+#define EDID_BLOCK_SIZE           128
+#define EDID_EXTENSION_COUNT      0x7E
+
+EFI_STATUS
+EFIAPI
+GetPanelEdid (
+  IN  EFI_EDID_OVERRIDE_PROTOCOL *This,
+  IN  EFI_HANDLE                 *ChildHandle,
+  OUT UINT32                     *Attributes,
+  IN OUT UINTN                   *EdidSize,
+  IN OUT UINT8                   **Edid
+  );
+
+EFI_EDID_OVERRIDE_PROTOCOL mEdidOverride = {
+  GetPanelEdid
+};
 
 //
 // Function implementations
@@ -54,9 +110,199 @@ GetPlatformLidStatus (
   return EFI_UNSUPPORTED;
 }
 
+/**
+  Tell whether an IGD context is that of the IGD at the fixed location.
+
+  @param Context  The IGD context
+
+  @retval TRUE   The IGD is at the fixed location.
+  @retval FALSE  The IGD is elsewhere.
+
+**/
+STATIC
+BOOLEAN
+IsFixedIgdLocation (
+  IN CONST IGD_CONTEXT_PROTOCOL *Context
+)
+{
+  return (BOOLEAN)(Context->Segment == ASSIGNED_IGD_PCI_SEGMENT &&
+                   Context->Bus == ASSIGNED_IGD_PCI_BUS &&
+                   Context->Device == ASSIGNED_IGD_PCI_DEVICE &&
+                   Context->Function == ASSIGNED_IGD_PCI_FUNCTION);
+}
+
+/**
+  Locate the OpRegion that IgdAssignmentDxe has set up, and validate its
+  signature.
+
+  @param OpRegion      Gives the address of the OpRegion
+
+  @param OpRegionSize  Gives the size of the memory set up for the OpRegion,
+                       including an extended VBT; zero if unknown
+
+  @retval EFI_STATUS.
+
+**/
+STATIC
+EFI_STATUS
+LocateOpRegion (
+   OUT IGD_OPREGION_STRUCTURE **OpRegion,
+   OUT UINTN *OpRegionSize
+)
+{
+  IGD_CONTEXT_PROTOCOL *Context;
+  EFI_HANDLE *Handles;
+  UINTN HandleCount;
+  UINTN Index;
+  EFI_STATUS Status;
+
+  /*
+   * Take the OpRegion from IgdAssignmentDxe, preferring the IGD at the fixed
+   * location over any other one. Fall back to reading ASLS of the IGD at the
+   * fixed location, for an OpRegion set up by other firmware.
+   */
+  *OpRegion = NULL;
+  *OpRegionSize = 0;
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gIgdContextProtocolGuid,
+                  NULL, &HandleCount, &Handles);
+  if (!EFI_ERROR (Status)) {
+    for (Index = 0; Index < HandleCount; Index++) {
+      Status = gBS->HandleProtocol (Handles[Index], &gIgdContextProtocolGuid,
+                      (VOID**)&Context);
+      if (EFI_ERROR (Status) || !Context->OpRegion) {
+        continue;
+      }
+      if (IsFixedIgdLocation (Context)) {
+        *OpRegion = (IGD_OPREGION_STRUCTURE*)(UINTN)Context->OpRegion;
+        *OpRegionSize = Context->OpRegionSize;
+        break;
+      }
+      if (!*OpRegion) {
+        *OpRegion = (IGD_OPREGION_STRUCTURE*)(UINTN)Context->OpRegion;
+        *OpRegionSize = Context->OpRegionSize;
+      }
+    }
+    gBS->FreePool (Handles);
+  }
+
+  if (!*OpRegion) {
+    *OpRegion = (IGD_OPREGION_STRUCTURE*)(UINTN)IgdPciRead32 (
+      ASSIGNED_IGD_PCI_BUS,
+      ASSIGNED_IGD_PCI_DEVICE,
+      ASSIGNED_IGD_PCI_FUNCTION,
+      ASSIGNED_IGD_PCI_ASLS_OFFSET);
+    ReportPciConfigAccess ();
+  }
+
+  /* Validate IGD OpRegion signature */
+  if (!*OpRegion) {
+    return EFI_UNSUPPORTED;
+  }
+  if (CompareMem ((*OpRegion)->Header.SIGN, IGD_OPREGION_HEADER_SIGN, sizeof((*OpRegion)->Header.SIGN)) != 0) {
+    DEBUG ((EFI_D_ERROR, "%a: Invalid OpRegion signature, expect %a\n",
+      __FUNCTION__, IGD_OPREGION_HEADER_SIGN));
+    return EFI_INVALID_PARAMETER;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Locate the VBT in the OpRegion that IgdAssignmentDxe has set up.
+
+  @param Vbt         Gives the address of the VBT inside the OpRegion
+
+  @param VbtSizeMax  Gives the size of the VBT storage in the OpRegion
+
+  @retval EFI_STATUS.
+
+**/
+STATIC
+EFI_STATUS
+LocateOpRegionVbt (
+   OUT VBT_HEADER **Vbt,
+   OUT UINT32 *VbtSizeMax
+)
+{
+  IGD_OPREGION_STRUCTURE *OpRegion;
+  UINTN OpRegionSize;
+  EFI_STATUS Status;
+  UINT16 VerMajor, VerMinor = 0;
+
+  Status = LocateOpRegion (&OpRegion, &OpRegionSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  VerMajor = OpRegion->Header.OVER >> 24;
+  VerMinor = OpRegion->Header.OVER >> 16 & 0xff;
+  /*
+   * OpRegion version and VBT size:
+   * Before 2.0: VBT is stored in OpRegion Mailbox 4 and the size won't exceed 6K.
+   * For 2.0 and 2.0+:
+   *   If VBT raw data size doesn't exceeds 6K, VBT is stored in Mailbox 4.
+   *   If exceeds 6K, VBT is stored in extended VBT region, the address and
+   *     size are stored in OpRegion head RVDA and RVDS.
+   *   - 2.0, RVDA holds the absolute physical address.
+   *   - 2.0+, RVDA holds the relative address OpRegion base, >= OpRegion size
+   * vfio-pci allocates a contigious memory to hold both OpRegion and VBT for
+   *   OpRegion 2.0 with >6K VBT and fake it to 2.1. So from OVMF perspective,
+   *   it shouldn't see OpRegion 2.0 with valid RVDA/RVDS. Otherwise the
+   *   vfio-pci driver needs updated.
+   */
+  if (VerMajor == 2 && VerMinor == 0 && OpRegion->MBox3.RVDA && OpRegion->MBox3.RVDS) {
+    DEBUG ((EFI_D_ERROR, "%a: Unsupported OpRegion version %d.%d with VBT larger than 0x%x\n",
+      __FUNCTION__, VerMajor, VerMinor, IGD_OPREGION_VBT_SIZE_6K));
+    return EFI_UNSUPPORTED;
+  }
+
+  if (VerMajor < 2 || !OpRegion->MBox3.RVDA || !OpRegion->MBox3.RVDS) {
+    *Vbt = (VBT_HEADER*)OpRegion->MBox4.RVBT;
+    *VbtSizeMax = IGD_OPREGION_VBT_SIZE_6K;
+  } else {
+    /* Keep the extended VBT inside the memory set up for the OpRegion */
+    if (OpRegionSize != 0 &&
+        (OpRegion->MBox3.RVDA > OpRegionSize ||
+         OpRegion->MBox3.RVDS > OpRegionSize - OpRegion->MBox3.RVDA)) {
+      DEBUG ((EFI_D_ERROR, "%a: Extended VBT 0x%Lx+0x%x out of OpRegion size 0x%Lx\n",
+        __FUNCTION__, OpRegion->MBox3.RVDA, OpRegion->MBox3.RVDS, (UINT64)OpRegionSize));
+      return EFI_INVALID_PARAMETER;
+    }
+    *Vbt = (VBT_HEADER*)((UINT8*)OpRegion + OpRegion->MBox3.RVDA);
+    *VbtSizeMax = OpRegion->MBox3.RVDS;
+  }
+
+  if (*VbtSizeMax < sizeof (VBT_HEADER)) {
+    DEBUG ((EFI_D_ERROR, "%a: Invalid VBT storage size 0x%x\n", __FUNCTION__,
+      *VbtSizeMax));
+    return EFI_INVALID_PARAMETER;
+  }
+  if ((*Vbt)->Table_Size < sizeof (VBT_HEADER)) {
+    DEBUG ((EFI_D_ERROR, "%a: Invalid VBT size 0x%x\n", __FUNCTION__,
+      (*Vbt)->Table_Size));
+    return EFI_INVALID_PARAMETER;
+  }
+  if ((*Vbt)->Table_Size > *VbtSizeMax) {
+    DEBUG ((EFI_D_ERROR, "%a: VBT Header reports larger size (0x%x) than OpRegion VBT storage (0x%x)\n",
+      __FUNCTION__, (*Vbt)->Table_Size, *VbtSizeMax));
+    return EFI_INVALID_PARAMETER;
+  }
+  if ((*Vbt)->Bios_Data_Offset > (*Vbt)->Table_Size ||
+      (*Vbt)->Table_Size - (*Vbt)->Bios_Data_Offset < sizeof (VBT_BIOS_DATA_HEADER)) {
+    DEBUG ((EFI_D_ERROR, "%a: BDB offset 0x%x out of VBT size 0x%x\n",
+      __FUNCTION__, (*Vbt)->Bios_Data_Offset, (*Vbt)->Table_Size));
+    return EFI_INVALID_PARAMETER;
+  }
+  return EFI_SUCCESS;
+}
+
 /**
   The function will execute and gives the Video Bios Table Size and Address.
 
+  The VBT is located and validated on the first call only; later calls are
+  served from the cached result. A VBT with a valid checksum is handed out
+  in place inside the OpRegion. Otherwise a copy with a fixed checksum is
+  made in boot services memory, below 4GB, which the OS can reclaim.
+
   @param VbtAddress  Gives the Physical Address of Video BIOS Table
 
   @param VbtSize     Gives the Size of Video BIOS Table
@@ -72,112 +318,206 @@ GetVbtData (
    OUT UINT32 *VbtSize
 )
 {
-  IGD_OPREGION_STRUCTURE *OpRegion;
-  EFI_STATUS Status = EFI_INVALID_PARAMETER;
-  UINT16 VerMajor, VerMinor = 0;
+  VBT_HEADER *Vbt;
+  EFI_STATUS Status;
   UINT32 VbtSizeMax = 0;
+  UINT8 CheckSum;
 
-  OpRegion = (IGD_OPREGION_STRUCTURE*)(UINTN)PciRead32 (
-    PCI_LIB_ADDRESS (
-      ASSIGNED_IGD_PCI_BUS,
-      ASSIGNED_IGD_PCI_DEVICE,
-      ASSIGNED_IGD_PCI_FUNCTION,
-      ASSIGNED_IGD_PCI_ASLS_OFFSET));
-
-  /* Validate IGD OpRegion signature and version */
-  if (OpRegion) {
-    if (CompareMem (OpRegion->Header.SIGN, IGD_OPREGION_HEADER_SIGN, sizeof(OpRegion->Header.SIGN)) != 0) {
-      DEBUG ((EFI_D_ERROR, "%a: Invalid OpRegion signature, expect %a\n",
-        __FUNCTION__, IGD_OPREGION_HEADER_SIGN));
-      return EFI_INVALID_PARAMETER;
-    } else {
-      VerMajor = OpRegion->Header.OVER >> 24;
-      VerMinor = OpRegion->Header.OVER >> 16 & 0xff;
-      /*
-       * OpRegion version and VBT size:
-       * Before 2.0: VBT is stored in OpRegion Mailbox 4 and the size won't exceed 6K.
-       * For 2.0 and 2.0+:
-       *   If VBT raw data size doesn't exceeds 6K, VBT is stored in Mailbox 4.
-       *   If exceeds 6K, VBT is stored in extended VBT region, the address and
-       *     size are stored in OpRegion head RVDA and RVDS.
-       *   - 2.0, RVDA holds the absolute physical address.
-       *   - 2.0+, RVDA holds the relative address OpRegion base, >= OpRegion size
-       * vfio-pci allocates a contigious memory to hold both OpRegion and VBT for
-       *   OpRegion 2.0 with >6K VBT and fake it to 2.1. So from OVMF perspective,
-       *   it shouldn't see OpRegion 2.0 with valid RVDA/RVDS. Otherwise the
-       *   vfio-pci driver needs updated.
-       */
-      if (VerMajor < 2) {
-        VbtSizeMax = IGD_OPREGION_VBT_SIZE_6K;
-        if (((VBT_HEADER*)&OpRegion->MBox4)->Table_Size > IGD_OPREGION_VBT_SIZE_6K) {
-          DEBUG ((EFI_D_ERROR, "%a: VBT Header reports larger size (0x%x) than OpRegion VBT Mailbox (0x%x)\n",
-            __FUNCTION__,
-            ((VBT_HEADER*)&OpRegion->MBox4)->Table_Size, IGD_OPREGION_VBT_SIZE_6K));
-          VbtSizeMax = 0;
-          return EFI_INVALID_PARAMETER;
-        }
-      } else if (VerMajor == 2 && VerMinor == 0 && OpRegion->MBox3.RVDA && OpRegion->MBox3.RVDS){
-        DEBUG ((EFI_D_ERROR, "%a: Unsupported OpRegion version %d.%d with VBT larger than 0x%x\n",
-          __FUNCTION__, VerMajor, VerMinor, IGD_OPREGION_VBT_SIZE_6K));
-        VbtSizeMax = 0;
-        return EFI_UNSUPPORTED;
-      } else {
-        VbtSizeMax = IGD_OPREGION_VBT_SIZE_6K;
-        if (OpRegion->MBox3.RVDA && OpRegion->MBox3.RVDS) {
-          VbtSizeMax = OpRegion->MBox3.RVDS;
-        }
-      }
-    }
+  if (mVbt) {
+    *VbtAddress = mVbt;
+    *VbtSize = mVbtSize;
+    return EFI_SUCCESS;
   }
 
-  if (mVbt) {
-    Status = gBS->FreePages (
-                    mVbt,
-                    EFI_SIZE_TO_PAGES (VbtSizeMax)
-                    );
+  Status = LocateOpRegionVbt (&Vbt, &VbtSizeMax);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
-  /* Only operates VBT on support OpRegion */
-  if (VbtSizeMax) {
+  CheckSum = VbtChecksum ((UINT8*)Vbt, Vbt->Table_Size);
+  if (CheckSum == 0) {
+    mVbt = (EFI_PHYSICAL_ADDRESS)(UINTN)Vbt;
+  } else {
     mVbt = SIZE_4GB - 1;
     Status = gBS->AllocatePages (
                     AllocateMaxAddress,
-                    EfiReservedMemoryType,
-                    EFI_SIZE_TO_PAGES (VbtSizeMax),
+                    EfiBootServicesData,
+                    EFI_SIZE_TO_PAGES (Vbt->Table_Size),
                     &mVbt
                     );
     if (EFI_ERROR (Status)) {
-      DEBUG ((EFI_D_ERROR, "%a: AllocatePages failed for VBT size 0x%x status %d\n",
-        __FUNCTION__, VbtSizeMax, Status));
+      DEBUG ((EFI_D_ERROR, "%a: AllocatePages failed for VBT size 0x%x status %r\n",
+        __FUNCTION__, Vbt->Table_Size, Status));
+      mVbt = 0;
       return EFI_OUT_OF_RESOURCES;
-    } else {
-      UINT8 CheckSum = 0;
-
-      /* Zero-out first*/
-      ZeroMem ((VOID*)mVbt, VbtSizeMax);
-      /* Only copy with size as specified in VBT table */
-      if (VerMajor < 2 || !OpRegion->MBox3.RVDA || !OpRegion->MBox3.RVDS) {
-        CopyMem((VOID*)mVbt, (VOID*)OpRegion->MBox4.RVBT, ((VBT_HEADER*)&OpRegion->MBox4)->Table_Size);
-      } else {
-        CopyMem((VOID*)mVbt, (VOID*)OpRegion + OpRegion->MBox3.RVDA, OpRegion->MBox3.RVDS);
-      }
+    }
 
-      /* Fix the checksum */
-      for (UINT32 i = 0; i < ((VBT_HEADER*)mVbt)->Table_Size; i++) {
-        CheckSum = (CheckSum + ((UINT8*)mVbt)[i]) & 0xFF;
-      }
-      ((VBT_HEADER*)mVbt)->Checksum += (0x100 - CheckSum);
-
-      *VbtAddress = mVbt;
-      *VbtSize = ((VBT_HEADER*)mVbt)->Table_Size;
-      DEBUG ((DEBUG_INFO, "%a: VBT Version %d size 0x%x\n", __FUNCTION__,
-        ((VBT_BIOS_DATA_HEADER*)(mVbt + ((VBT_HEADER*)mVbt)->Bios_Data_Offset))->BDB_Version,
-        ((VBT_HEADER*)mVbt)->Table_Size));
-      return EFI_SUCCESS;
+    /* Fix the checksum of the copy */
+    CopyMem ((VOID*)(UINTN)mVbt, Vbt, Vbt->Table_Size);
+    ((VBT_HEADER*)(UINTN)mVbt)->Checksum += (UINT8)(0x100 - CheckSum);
+  }
+  mVbtSize = Vbt->Table_Size;
+
+  *VbtAddress = mVbt;
+  *VbtSize = mVbtSize;
+  DEBUG ((DEBUG_INFO, "%a: VBT Version %d size 0x%x%a\n", __FUNCTION__,
+    ((VBT_BIOS_DATA_HEADER*)((UINT8*)Vbt + Vbt->Bios_Data_Offset))->BDB_Version,
+    mVbtSize, CheckSum == 0 ? "" : ", checksum fixed in copy"));
+  return EFI_SUCCESS;
+}
+
+/**
+  Look up a BIOS Data Block of the VBT by its ID. The VBT is located and its
+  blocks are indexed on the first call.
+
+  @param This     The protocol instance
+
+  @param BlockId  ID of the block
+
+  @param Block    Gives the block data, following the block header
+
+  @param Size     Gives the size of the block data
+
+  @retval EFI_STATUS.
+
+**/
+EFI_STATUS
+EFIAPI
+GetVbtBlock (
+  IN  IGD_VBT_INDEX_PROTOCOL *This,
+  IN  UINT8                  BlockId,
+  OUT CONST VOID             **Block,
+  OUT UINT32                 *Size
+  )
+{
+  EFI_PHYSICAL_ADDRESS VbtAddress;
+  UINT32 VbtSize;
+  EFI_STATUS Status;
+
+  if (!mVbtIndexed) {
+    Status = GetVbtData (&VbtAddress, &VbtSize);
+    if (EFI_ERROR (Status)) {
+      return Status;
     }
+    Status = BuildVbtIndex ((VBT_HEADER*)(UINTN)VbtAddress);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    mVbtIndexed = TRUE;
   }
 
-  return EFI_UNSUPPORTED;
+  return LookupVbtBlock (BlockId, Block, Size);
+}
+
+/**
+  Tell whether a child handle of the GOP is an internal panel, by the display
+  type in the ACPI _ADR node of its device path.
+
+  @param ChildHandle  The child handle
+
+  @retval TRUE if the child handle is an internal panel.
+
+**/
+STATIC
+BOOLEAN
+IsInternalPanel (
+  IN EFI_HANDLE ChildHandle
+)
+{
+  EFI_DEVICE_PATH_PROTOCOL *DevicePath;
+  ACPI_ADR_DEVICE_PATH *AcpiAdr;
+  EFI_STATUS Status;
+
+  Status = gBS->HandleProtocol (ChildHandle, &gEfiDevicePathProtocolGuid, (VOID**)&DevicePath);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  for (; !IsDevicePathEnd (DevicePath); DevicePath = NextDevicePathNode (DevicePath)) {
+    if (DevicePathType (DevicePath) == ACPI_DEVICE_PATH &&
+        DevicePathSubType (DevicePath) == ACPI_ADR_DP) {
+      AcpiAdr = (ACPI_ADR_DEVICE_PATH*)DevicePath;
+      return ((AcpiAdr->ADR >> 8) & 0xF) == ACPI_ADR_DISPLAY_TYPE_INTERNAL_DIGITAL;
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Give the GOP the EDID of the internal panel from OpRegion Mailbox 5, so
+  that it needn't read the EDID over DDC. Other displays are left to DDC.
+
+  @param This         The protocol instance
+
+  @param ChildHandle  The child handle of the display
+
+  @param Attributes   Gives the EFI_EDID_OVERRIDE_* attributes
+
+  @param EdidSize     Gives the size of the EDID
+
+  @param Edid         Gives the EDID
+
+  @retval EFI_SUCCESS      The EDID of the internal panel is returned.
+  @retval EFI_UNSUPPORTED  There is no EDID for this display.
+
+**/
+EFI_STATUS
+EFIAPI
+GetPanelEdid (
+  IN  EFI_EDID_OVERRIDE_PROTOCOL *This,
+  IN  EFI_HANDLE                 *ChildHandle,
+  OUT UINT32                     *Attributes,
+  IN OUT UINTN                   *EdidSize,
+  IN OUT UINT8                   **Edid
+  )
+{
+  STATIC CONST UINT8 EdidHeader[] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+  IGD_OPREGION_STRUCTURE *OpRegion;
+  EFI_STATUS Status;
+  UINTN OpRegionSize;
+  UINTN Size;
+  UINTN Offset;
+
+  if (ChildHandle == NULL || !IsInternalPanel (*ChildHandle)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = LocateOpRegion (&OpRegion, &OpRegionSize);
+  if (EFI_ERROR (Status) || !(OpRegion->Header.MBOX & IGD_OPREGION_HEADER_MBOX5)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Size = (OpRegion->MBox5.PHED & OPREGION_PHED_EDID_BLOCKS) * EDID_BLOCK_SIZE;
+  Size = MIN (Size, sizeof (OpRegion->MBox5.BDDC));
+  if (Size == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  /* Validate the EDID header and the checksum of the base block */
+  if (CompareMem (OpRegion->MBox5.BDDC, EdidHeader, sizeof (EdidHeader)) != 0 ||
+      CalculateSum8 (OpRegion->MBox5.BDDC, EDID_BLOCK_SIZE) != 0) {
+    DEBUG ((EFI_D_ERROR, "%a: Invalid panel EDID in OpRegion\n", __FUNCTION__));
+    return EFI_UNSUPPORTED;
+  }
+
+  /* Hand out the base block only if the extension blocks are inconsistent */
+  for (Offset = EDID_BLOCK_SIZE; Offset < Size; Offset += EDID_BLOCK_SIZE) {
+    if (CalculateSum8 (OpRegion->MBox5.BDDC + Offset, EDID_BLOCK_SIZE) != 0) {
+      break;
+    }
+  }
+  if (Offset < Size ||
+      OpRegion->MBox5.BDDC[EDID_EXTENSION_COUNT] != Size / EDID_BLOCK_SIZE - 1) {
+    DEBUG ((DEBUG_WARN, "%a: Invalid panel EDID extension blocks in OpRegion, ignoring\n",
+      __FUNCTION__));
+    Size = EDID_BLOCK_SIZE;
+  }
+
+  *Attributes = 0;
+  *EdidSize = Size;
+  *Edid = OpRegion->MBox5.BDDC;
+  DEBUG ((DEBUG_INFO, "%a: panel EDID size 0x%Lx from OpRegion\n", __FUNCTION__, (UINT64)Size));
+  return EFI_SUCCESS;
 }
 
 /**
@@ -220,6 +560,10 @@ PlatformGopPolicyEntryPoint (
                   &ImageHandle,
                   &gPlatformGopPolicyGuid,
                   &mPlatformGopPolicy,
+                  &gIgdVbtIndexProtocolGuid,
+                  &mVbtIndex,
+                  &gEfiEdidOverrideProtocolGuid,
+                  &mEdidOverride,
                   NULL
                   );
 
@@ -0,0 +1,238 @@
+/** @file
+
+  Index of the BIOS Data Blocks (BDBs) of the VBT. The blocks follow the BDB
+  header back to back, each with a 1-byte ID and a 2-byte size, except for
+  the MIPI sequence block from version 3 on, so finding a block means walking
+  all blocks before it. The walk is done once, recording
+  the location of each block by ID.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+
+#include "VbtIndex.h"
+
+//
+// size of a block header: UINT8 ID, UINT16 size
+//
+#define BDB_BLOCK_HEADER_SIZE  3
+
+//
+// From version 3 on, the MIPI sequence block has outgrown the 2-byte size; the
+// real size is a UINT32 following the 1-byte version at the start of the
+// block data.
+//
+#define BDB_MIPI_SEQUENCE             53
+#define BDB_MIPI_SEQUENCE_SIZE_V3     3
+#define BDB_MIPI_SEQUENCE_SIZE_OFFSET 4
+
+//
+// Mask of the even bytes of a UINT64, and the number of UINT64 words whose
+// byte pairs can be summed into 16-bit lanes before a lane may overflow.
+//
+#define EVEN_BYTES_MASK        0x00FF00FF00FF00FFULL
+#define EVEN_LANES_MASK        0x0000FFFF0000FFFFULL
+#define WORDS_PER_LANE_FOLD    128
+
+typedef struct {
+  UINT32 Offset;    // offset of the block data from the VBT; zero if absent
+  UINT32 Size;
+} VBT_BLOCK;
+
+STATIC CONST VBT_HEADER *mIndexedVbt;
+STATIC VBT_BLOCK        mBlocks[256];
+
+
+/**
+  Calculate the 8-bit sum of a buffer, eight bytes at a time.
+
+  @param[in] Buffer  The buffer to sum.
+  @param[in] Length  The size of the buffer in bytes.
+
+  @return  The sum of all bytes, modulo 256.
+**/
+UINT8
+EFIAPI
+VbtChecksum (
+  IN CONST UINT8 *Buffer,
+  IN UINTN       Length
+  )
+{
+  UINT64 Word;
+  UINT64 Lanes;
+  UINTN  Words;
+  UINT32 Sum;
+
+  Sum = 0;
+  while (Length >= sizeof Word) {
+    //
+    // Add the even and odd bytes of each word into four 16-bit lanes, and
+    // fold the lanes before they can overflow.
+    //
+    Lanes = 0;
+    for (Words = 0;
+         Words < WORDS_PER_LANE_FOLD && Length >= sizeof Word;
+         Words++) {
+      Word = ReadUnaligned64 ((CONST UINT64 *)Buffer);
+      Lanes += (Word & EVEN_BYTES_MASK) +
+               (RShiftU64 (Word, 8) & EVEN_BYTES_MASK);
+      Buffer += sizeof Word;
+      Length -= sizeof Word;
+    }
+    Lanes = (Lanes & EVEN_LANES_MASK) +
+            (RShiftU64 (Lanes, 16) & EVEN_LANES_MASK);
+    Sum += (UINT32)Lanes + (UINT32)RShiftU64 (Lanes, 32);
+  }
+
+  while (Length > 0) {
+    Sum += *Buffer++;
+    Length--;
+  }
+  return (UINT8)Sum;
+}
+
+
+/**
+  Get the size of the data of a BIOS Data Block, like _get_blocksize() in the
+  i915 driver of Linux.
+
+  @param[in]  Block      The block header.
+  @param[in]  Available  The number of bytes available at Block, at least
+                         BDB_BLOCK_HEADER_SIZE.
+  @param[out] Size       The size of the block data.
+
+  @retval TRUE   Size has been read.
+  @retval FALSE  The size field of the block is out of bounds.
+**/
+STATIC
+BOOLEAN
+GetBlockSize (
+  IN  CONST UINT8 *Block,
+  IN  UINTN       Available,
+  OUT UINT32      *Size
+  )
+{
+  if (Block[0] == BDB_MIPI_SEQUENCE && Available > BDB_BLOCK_HEADER_SIZE &&
+      Block[BDB_BLOCK_HEADER_SIZE] >= BDB_MIPI_SEQUENCE_SIZE_V3) {
+    if (Available < BDB_MIPI_SEQUENCE_SIZE_OFFSET + sizeof (UINT32)) {
+      return FALSE;
+    }
+    *Size = ReadUnaligned32 ((CONST UINT32 *)(Block +
+                                              BDB_MIPI_SEQUENCE_SIZE_OFFSET));
+    return TRUE;
+  }
+  *Size = ReadUnaligned16 ((CONST UINT16 *)(Block + 1));
+  return TRUE;
+}
+
+
+/**
+  Index the BIOS Data Blocks of a VBT in one pass. Blocks that don't fit in
+  the BDB are not indexed.
+
+  @param[in] Vbt  The VBT, whose Table_Size has been validated.
+
+  @retval EFI_SUCCESS            The index has been built.
+  @retval EFI_INVALID_PARAMETER  The BDB header is out of bounds.
+**/
+EFI_STATUS
+EFIAPI
+BuildVbtIndex (
+  IN CONST VBT_HEADER *Vbt
+  )
+{
+  CONST VBT_BIOS_DATA_HEADER *Bdb;
+  UINTN                      BdbSize;
+  UINTN                      Position;
+  UINT8                      BlockId;
+  UINT32                     BlockSize;
+  UINTN                      Blocks;
+
+  mIndexedVbt = NULL;
+  ZeroMem (mBlocks, sizeof mBlocks);
+
+  if (Vbt->Bios_Data_Offset > Vbt->Table_Size ||
+      Vbt->Table_Size - Vbt->Bios_Data_Offset < sizeof (VBT_BIOS_DATA_HEADER)) {
+    DEBUG ((DEBUG_ERROR, "%a: BDB offset 0x%x out of bounds\n", __FUNCTION__,
+      Vbt->Bios_Data_Offset));
+    return EFI_INVALID_PARAMETER;
+  }
+  Bdb = (CONST VBT_BIOS_DATA_HEADER *)((CONST UINT8 *)Vbt +
+                                       Vbt->Bios_Data_Offset);
+  BdbSize = MIN (Bdb->BDB_Size, Vbt->Table_Size - Vbt->Bios_Data_Offset);
+  if (Bdb->BDB_Header_Size < sizeof (VBT_BIOS_DATA_HEADER) ||
+      Bdb->BDB_Header_Size > BdbSize) {
+    DEBUG ((DEBUG_ERROR, "%a: BDB header size 0x%x out of bounds\n",
+      __FUNCTION__, Bdb->BDB_Header_Size));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Blocks   = 0;
+  Position = Bdb->BDB_Header_Size;
+  while (BdbSize - Position >= BDB_BLOCK_HEADER_SIZE) {
+    BlockId = ((CONST UINT8 *)Bdb)[Position];
+    if (!GetBlockSize ((CONST UINT8 *)Bdb + Position, BdbSize - Position,
+           &BlockSize)) {
+      DEBUG ((DEBUG_WARN, "%a: block %d size out of bounds, stopping\n",
+        __FUNCTION__, BlockId));
+      break;
+    }
+    Position += BDB_BLOCK_HEADER_SIZE;
+    if (BlockSize > BdbSize - Position) {
+      DEBUG ((DEBUG_WARN, "%a: block %d size 0x%x out of bounds, stopping\n",
+        __FUNCTION__, BlockId, BlockSize));
+      break;
+    }
+
+    //
+    // Keep the first instance of a block.
+    //
+    if (mBlocks[BlockId].Offset == 0) {
+      mBlocks[BlockId].Offset = Vbt->Bios_Data_Offset + (UINT32)Position;
+      mBlocks[BlockId].Size   = BlockSize;
+    }
+    Position += BlockSize;
+    Blocks++;
+  }
+
+  mIndexedVbt = Vbt;
+  DEBUG ((DEBUG_INFO, "%a: %Lu blocks in 0x%Lx bytes\n", __FUNCTION__,
+    (UINT64)Blocks, (UINT64)BdbSize));
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Look up a BIOS Data Block in the index built by BuildVbtIndex().
+
+  @param[in]  BlockId  ID of the block.
+  @param[out] Block    The block data, following the block header.
+  @param[out] Size     The size of the block data.
+
+  @retval EFI_SUCCESS    The block has been found.
+  @retval EFI_NOT_FOUND  There is no such block, or no index.
+**/
+EFI_STATUS
+EFIAPI
+LookupVbtBlock (
+  IN  UINT8      BlockId,
+  OUT CONST VOID **Block,
+  OUT UINT32     *Size
+  )
+{
+  if (mIndexedVbt == NULL || mBlocks[BlockId].Offset == 0) {
+    return EFI_NOT_FOUND;
+  }
+  *Block = (CONST UINT8 *)mIndexedVbt + mBlocks[BlockId].Offset;
+  *Size  = mBlocks[BlockId].Size;
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,68 @@
+/** @file
+
+  Internal function declarations for the VBT BIOS Data Block index.
+
+  This program and the accompanying materials are licensed and made available
+  under the terms and conditions of the BSD License which accompanies this
+  distribution. The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS, WITHOUT
+  WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+**/
+
+#ifndef _VBT_INDEX_H_
+#define _VBT_INDEX_H_
+
+#include <Uefi.h>
+#include <IndustryStandard/IgdOpRegion.h>
+
+/**
+  Calculate the 8-bit sum of a buffer, eight bytes at a time.
+
+  @param[in] Buffer  The buffer to sum.
+  @param[in] Length  The size of the buffer in bytes.
+
+  @return  The sum of all bytes, modulo 256.
+**/
+UINT8
+EFIAPI
+VbtChecksum (
+  IN CONST UINT8 *Buffer,
+  IN UINTN       Length
+  );
+
+/**
+  Index the BIOS Data Blocks of a VBT in one pass. Blocks that don't fit in
+  the BDB are not indexed.
+
+  @param[in] Vbt  The VBT, whose Table_Size has been validated.
+
+  @retval EFI_SUCCESS            The index has been built.
+  @retval EFI_INVALID_PARAMETER  The BDB header is out of bounds.
+**/
+EFI_STATUS
+EFIAPI
+BuildVbtIndex (
+  IN CONST VBT_HEADER *Vbt
+  );
+
+/**
+  Look up a BIOS Data Block in the index built by BuildVbtIndex().
+
+  @param[in]  BlockId  ID of the block.
+  @param[out] Block    The block data, following the block header.
+  @param[out] Size     The size of the block data.
+
+  @retval EFI_SUCCESS    The block has been found.
+  @retval EFI_NOT_FOUND  There is no such block, or no index.
+**/
+EFI_STATUS
+EFIAPI
+LookupVbtBlock (
+  IN  UINT8      BlockId,
+  OUT CONST VOID **Block,
+  OUT UINT32     *Size
+  );
+
+#endif
@@ -21,6 +21,7 @@ BUILD_TOOLCHAIN=GCC
 device_id=0xffff
 output_file=
 gop_file=
+igd_gen=ALL
 
 help() {
     echo "Usage: $0 [options] <output>"
@@ -29,6 +30,8 @@ help() {
     echo "  -i, --device <device id>      Device ID for Option ROM, default is 0xffff"
     echo "  -g, --gop <file>              Path to Intel GOP driver"
     echo "  -r, --release                 Trigger a release build"
+    echo "      --gen <generation>        Only support one IGD generation, one of"
+    echo "                                gen6, gen8, chv, gen9, gen11, xe or all (default)"
 }
 
 while [ $# -gt 0 ]; do
@@ -53,6 +56,18 @@ while [ $# -gt 0 ]; do
         -r|--release)
             BUILD_TARGET=RELEASE
             ;;
+        --gen)
+            shift
+            igd_gen=$(echo $1 | tr '[:lower:]' '[:upper:]')
+            case $igd_gen in
+                GEN6|GEN8|CHV|GEN9|GEN11|XE|ALL)
+                    ;;
+                *)
+                    echo "Unknown IGD generation: $1"
+                    exit 1
+                    ;;
+            esac
+            ;;
         -)
             echo "Unknown option: $1"
             exit 1
@@ -77,7 +92,7 @@ fi
 
 BUILD_OUTPUT_DIR=$WORKSPACE/Build/VfioIgdPkg/"$BUILD_TARGET"_"$BUILD_TOOLCHAIN"/$BUILD_ARCH
 
-build -b $BUILD_TARGET -a $BUILD_ARCH -t $BUILD_TOOLCHAIN -p $DSC_PATH
+build -b $BUILD_TARGET -a $BUILD_ARCH -t $BUILD_TOOLCHAIN -p $DSC_PATH -D IGD_GEN=$igd_gen
 
 if [ -z $gop_file ]; then
     echo "Generating non-GOP IGD Option ROM with IgdAssignmentDxe..."